@@ -1,8 +1,7 @@
 #include "AIMPString.h"
-#include <codecvt>
+#include "Utf.h"
 
 IAIMPCore *AIMPString::m_core = nullptr;
-static std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>> wStrConverter;
 
 AIMPString::AIMPString() {
     if (!m_core)
@@ -36,7 +35,8 @@ AIMPString::AIMPString(const rapidjson::Value &val) {
     if (SUCCEEDED(m_core->CreateObject(IID_IAIMPString, reinterpret_cast<void **>(&m_string)))) {
         if (val.IsString() && val.GetStringLength() > 0) {
             const char *ptr = val.GetString();
-            std::wstring str = wStrConverter.from_bytes(ptr, ptr + val.GetStringLength());
+            std::wstring str;
+            Utf::ToUtf16(ptr, val.GetStringLength(), str);
             m_string->SetData(const_cast<wchar_t *>(str.data()), str.size());
         } else {
             m_string->Release();
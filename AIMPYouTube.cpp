@@ -13,6 +13,15 @@
 #include "PlayerHook.h"
 #include "FileSystem.h"
 #include "ArtworkProvider.h"
+#include "CacheEvictor.h"
+#include "PlaylistValidator.h"
+#include "MetadataRefresher.h"
+#include "PlaylistIndex.h"
+#include "PlaylistMutations.h"
+#include "PlaylistSnapshot.h"
+#include "MainThread.h"
+#include "MonitorEngine.h"
+#include "PushSubscriber.h"
 #include <set>
 #include <ctime>
 
@@ -23,7 +32,11 @@ HRESULT __declspec(dllexport) WINAPI AIMPPluginGetHeader(IAIMPPlugin **Header) {
 
 Plugin *Plugin::m_instance = nullptr;
 
+static const unsigned int MonitorTickInterval = 10 * 60 * 1000; // ms between two checks for due monitor sources
+
 HRESULT WINAPI Plugin::Initialize(IAIMPCore *Core) {
+    ULONGLONG startTime = GetTickCount64();
+
     Gdiplus::GdiplusStartupInput gdiplusStartupInput;
     if (Gdiplus::GdiplusStartup(&m_gdiplusToken, &gdiplusStartupInput, NULL) != Gdiplus::Status::Ok)
         return E_FAIL;
@@ -39,8 +52,14 @@ HRESULT WINAPI Plugin::Initialize(IAIMPCore *Core) {
       if (!Config::Init(Core)) { Finalize(); return E_FAIL; }
     if (!AimpHTTP::Init(Core)) { Finalize(); return E_FAIL; }
     if (!AimpMenu::Init(Core)) { Finalize(); return E_FAIL; }
+    if (!MainThread::Init())   { Finalize(); return E_FAIL; }
 
-    Config::LoadExtendedConfig();
+    // Menus and extensions don't need it, users of the data wait on Config::WaitUntilLoaded()
+    Config::BeginLoadExtendedConfig([this] {
+        UpdatePlaylistMenu();
+        PushSubscriber::Start();
+        PlaylistMutations::Start();
+    });
 
     m_accessToken = Config::GetString(L"AccessToken");
     m_refreshToken = Config::GetString(L"RefreshToken");
@@ -56,13 +75,13 @@ HRESULT WINAPI Plugin::Initialize(IAIMPCore *Core) {
     }
 
     auto enableIfValid = [this](IAIMPMenuItem *item) {
-        int valid = 0;
-        ForSelectedTracks([&valid](IAIMPPlaylist *, IAIMPPlaylistItem *, const std::wstring &id) -> int {
-            if (!id.empty()) valid++;
-            return 0;
-        });
+        bool valid = false;
+        if (IAIMPPlaylist *pl = GetCurrentPlaylist()) {
+            valid = !PlaylistIndex::Selection(pl).empty();
+            pl->Release();
+        }
 
-        item->SetValueAsInt32(AIMP_MENUITEM_PROPID_VISIBLE, valid > 0);
+        item->SetValueAsInt32(AIMP_MENUITEM_PROPID_VISIBLE, valid);
     };
 
     if (AimpMenu *contextMenu = AimpMenu::Get(AIMP_MENUID_PLAYER_PLAYLIST_CONTEXT_FUNCTIONS)) {
@@ -89,6 +108,7 @@ HRESULT WINAPI Plugin::Initialize(IAIMPCore *Core) {
                 }
                 return 0;
             });
+            Config::MarkDirty(Config::ShardExclusions);
             Config::SaveExtendedConfig();
         }, IDB_ICON, enableIfValid)->Release();
 
@@ -139,33 +159,40 @@ HRESULT WINAPI Plugin::Initialize(IAIMPCore *Core) {
         return E_FAIL;
     }
 
-    if (Config::GetInt32(L"CheckOnStartup", 1)) {
-        Timer::SingleShot(2000, MonitorCallback);
+    if (Config::Current().CheckOnStartup) {
+        Timer::SingleShot(2000, StartupCheck);
     }
 
     StartMonitorTimer();
-    UpdatePlaylistMenu();
-
-	//for some fucking reason config->getvalue doesn't work directly in YouTubeAPI::GetStreamUrl
-	m_youtubeDLCmd = Config::GetString(L"YoutubeDL", L"-f best[ext=mp4]/best");
-	m_youtubeDLTimeout = Config::GetInt32(L"YoutubeDLTimeout", 30);
+    CacheEvictor::Start();
+    PlaylistValidator::Start();
+    MetadataRefresher::Start();
+
+    Config::OnSettingsChanged([this](const Config::Settings &oldSettings, const Config::Settings &newSettings) {
+        if (oldSettings.CheckEveryEnabled != newSettings.CheckEveryEnabled || oldSettings.CheckEveryHours != newSettings.CheckEveryHours) {
+            KillMonitorTimer();
+            StartMonitorTimer();
+        }
+        if (oldSettings.PushEnabled != newSettings.PushEnabled || oldSettings.PushCallbackUrl != newSettings.PushCallbackUrl || oldSettings.PushPort != newSettings.PushPort) {
+            if (Config::IsLoaded())
+                PushSubscriber::Restart();
+        }
+    });
 
+    DebugW(L"AIMPYouTube: initialized in %llu ms\n", GetTickCount64() - startTime);
     return S_OK;
 }
 
-std::wstring Plugin::YoutubeDLCmd() const { return m_youtubeDLCmd; }
-int Plugin::YoutubeDLTimeout() const { return m_youtubeDLTimeout; }
-void Plugin::YoutubeDLCmd(std::wstring value) { Config::SetString(L"YoutubeDL", m_youtubeDLCmd = value); }
-void Plugin::YoutubeDLTimeout(int value) { Config::SetInt32(L"YoutubeDLTimeout", m_youtubeDLTimeout = value); }
-
 void Plugin::StartMonitorTimer() {
-    bool enabled = Config::GetInt32(L"CheckEveryEnabled", 1) == 1;
-    if (m_monitorTimer > 0 && enabled)
+    const Config::Settings &settings = Config::Current();
+    if (m_monitorTimer > 0 && settings.CheckEveryEnabled)
         return;
 
     KillMonitorTimer();
-    if (enabled) {
-        m_monitorTimer = Timer::Schedule(Config::GetInt32(L"CheckEveryHours", 1) * 60 * 60 * 1000, MonitorCallback);
+    if (settings.CheckEveryEnabled) {
+        // Each source has its own due time (see MonitorEngine), CheckEveryHours is the shortest interval
+        unsigned int tick = (std::min)((unsigned int)settings.CheckEveryHours * 60 * 60 * 1000, MonitorTickInterval);
+        m_monitorTimer = Timer::Schedule(tick, MonitorTick);
     }
 }
 
@@ -177,62 +204,70 @@ void Plugin::KillMonitorTimer() {
 }
 
 void Plugin::MonitorCallback() {
-    if (m_instance->m_monitorPendingUrls.empty()) {
-        for (const auto &x : Config::MonitorUrls) {
-            m_instance->m_monitorPendingUrls.push(x);
-        }
-        if (m_instance->isConnected()) {
-            std::wstring auth = L"\r\nAuthorization: Bearer " + m_instance->m_accessToken;
-
-            // Load user playlists
-            AimpHTTP::Get(L"https://www.googleapis.com/youtube/v3/playlists?part=snippet&maxResults=50&mine=true&fields=items(id%2Csnippet)" + auth, [](unsigned char *data, int size) {
-                rapidjson::Document d;
-                d.Parse(reinterpret_cast<const char *>(data));
-
-                if (d.IsObject() && d.HasMember("items") && d["items"].IsArray() && d["items"].Size() > 0) {
-                    for (auto x = d["items"].Begin(), e = d["items"].End(); x != e; x++) {
-                        const rapidjson::Value &item = *x;
-                        std::wstring id(Tools::ToWString(item["id"]));
-                        auto find = [&](const Config::Playlist &p) -> bool { return p.ID == id; };
-                        if (std::find_if(Config::UserPlaylists.begin(), Config::UserPlaylists.end(), find) == Config::UserPlaylists.end()) {
-                            Config::UserPlaylists.push_back({ id, Tools::ToWString(item["snippet"]["localized"]["title"]), true });
-                        }
-                    }
-                }
-                m_instance->UpdatePlaylistMenu();
-            });
-        }
-    }
-    if (!m_instance->m_monitorPendingUrls.empty()) {
-        const Config::MonitorUrl &url = m_instance->m_monitorPendingUrls.front();
-        IAIMPPlaylist *pl = m_instance->GetPlaylistById(url.PlaylistID, false);
-        if (!pl) {
-            m_instance->m_monitorPendingUrls.pop();
-            if (!m_instance->m_monitorPendingUrls.empty())
-                MonitorCallback();
-            return;
-        }
+    Config::WaitUntilLoaded();
 
-        auto state = std::make_shared<YouTubeAPI::LoadingState>();
-        state->ReferenceName = url.GroupName;
-        state->Flags = url.Flags;
+    if (!MonitorEngine::IsRunning())
+        m_instance->RefreshUserPlaylists();
 
-        YouTubeAPI::GetExistingTrackIds(pl, state);
-        if (m_instance->m_monitorPendingUrls.size() > 1) {
-            YouTubeAPI::LoadFromUrl(url.URL, pl, state, MonitorCallback);
-        } else {
-            YouTubeAPI::LoadFromUrl(url.URL, pl, state); // last one without callback
-        }
-        m_instance->m_monitorPendingUrls.pop();
+    MonitorEngine::StartSweep(false);
+}
+
+void Plugin::StartupCheck() {
+    Config::WaitUntilLoaded();
+
+    if (!MonitorEngine::IsRunning())
+        m_instance->RefreshUserPlaylists();
+
+    // Only what came due while AIMP was closed, the rest keeps its jittered due time
+    MonitorEngine::StartSweep(true);
+}
+
+void Plugin::MonitorTick() {
+    Config::WaitUntilLoaded();
+
+    if (!MonitorEngine::IsRunning() && std::time(nullptr) - m_instance->m_userPlaylistsRefreshed >= Config::Current().CheckEveryHours * 60 * 60)
+        m_instance->RefreshUserPlaylists();
+
+    MonitorEngine::StartSweep(true);
+}
+
+void Plugin::RefreshUserPlaylists() {
+    m_userPlaylistsRefreshed = std::time(nullptr);
+    if (isConnected()) {
+        std::wstring auth = L"\r\nAuthorization: Bearer " + m_accessToken;
+
+        // Load user playlists
+        AimpHTTP::Get(L"https://www.googleapis.com/youtube/v3/playlists?part=snippet&maxResults=50&mine=true&fields=items(id%2Csnippet)" + auth, [](unsigned char *data, int size) {
+            ResponseDecoder::Response r;
+            ResponseDecoder::Decode(reinterpret_cast<char *>(data), r);
+
+            for (const auto &item : r.Items) {
+                const std::wstring &id = item.Id;
+                auto find = [&](const Config::Playlist &p) -> bool { return p.ID == id; };
+                if (std::find_if(Config::UserPlaylists.begin(), Config::UserPlaylists.end(), find) == Config::UserPlaylists.end()) {
+                    Config::UserPlaylists.push_back({ id, item.LocalizedTitle, true });
+                    Config::MarkDirty(Config::ShardPlaylistIndex);
+                }
+            }
+            m_instance->UpdatePlaylistMenu();
+        });
     }
 }
 
 HRESULT WINAPI Plugin::Finalize() {
+    MonitorEngine::Stop();
+    PlaylistMutations::Stop();
+    PushSubscriber::Stop();
+    CacheEvictor::Stop();
+    PlaylistValidator::Stop();
+    MetadataRefresher::Stop();
+    PlaylistIndex::Deinit();
     Timer::StopAll();
 
     AimpMenu::Deinit();
     AimpHTTP::Deinit();
     Config::Deinit();
+    MainThread::Deinit();
 
     if (m_messageDispatcher) {
         m_messageDispatcher->Unhook(m_messageHook);
@@ -361,100 +396,26 @@ void Plugin::ForSelectedTracks(std::function<int(IAIMPPlaylist *, IAIMPPlaylistI
     if (!callback)
         return;
 
+    Config::WaitUntilLoaded();
+
     if (IAIMPPlaylist *pl = GetCurrentPlaylist()) {
-        pl->BeginUpdate();
-        std::set<IAIMPPlaylistItem *> to_del;
-        auto delPending = [&] {
-            for (auto x : to_del) {
-                pl->Delete(x);
-                x->Release();
-            }
-        };
-        for (int i = 0, n = pl->GetItemCount(); i < n; ++i) {
-            IAIMPPlaylistItem *item = nullptr;
-            if (SUCCEEDED(pl->GetItem(i, IID_IAIMPPlaylistItem, reinterpret_cast<void **>(&item)))) {
-                int isSelected = 0;
-                if (SUCCEEDED(item->GetValueAsInt32(AIMP_PLAYLISTITEM_PROPID_SELECTED, &isSelected))) {
-                    if (isSelected) {
-                        IAIMPString *url = nullptr;
-                        if (SUCCEEDED(item->GetValueAsObject(AIMP_PLAYLISTITEM_PROPID_FILENAME, IID_IAIMPString, reinterpret_cast<void **>(&url)))) {
-                            std::wstring id = Tools::TrackIdFromUrl(url->GetData());
-                            url->Release();
-                            
-                            int result = callback(pl, item, id);
-                            if (result & FLAG_DELETE_ITEM) {
-                                to_del.insert(item);
-                                if (result & FLAG_STOP_LOOP) {
-                                    delPending();
-                                    pl->EndUpdate();
-                                    pl->Release();
-                                    return;
-                                }
-                                continue;
-                            }
-                            if (result & FLAG_STOP_LOOP) {
-                                delPending();
-                                item->Release();
-                                pl->EndUpdate();
-                                pl->Release();
-                                return;
-                            }
-                        }
-                    }
-                }
-                item->Release();
-            }
+        PlaylistSnapshot snapshot(pl, PlaylistSnapshot::Selection);
+        for (int i = 0, n = snapshot.Count(), left = snapshot.SelectedCount(); i < n && left > 0; ++i) {
+            if (!snapshot.IsSelected(i))
+                continue;
+            left--;
+
+            int result = callback(pl, snapshot.Item(i), snapshot.IdString(i));
+            if (result & FLAG_DELETE_ITEM)
+                snapshot.Delete(i);
+            if (result & FLAG_STOP_LOOP)
+                break;
         }
-        delPending();
-        pl->EndUpdate();
+        snapshot.Commit();
         pl->Release();
     }
 }
 
-void Plugin::ForEveryItem(IAIMPPlaylist *pl, std::function<int(IAIMPPlaylistItem *, IAIMPFileInfo *, const std::wstring &)> callback) {
-    if (!pl || !callback)
-        return;
-
-    pl->BeginUpdate();
-    for (int i = 0, n = pl->GetItemCount(); i < n; ++i) {
-        IAIMPPlaylistItem *item = nullptr;
-        if (SUCCEEDED(pl->GetItem(i, IID_IAIMPPlaylistItem, reinterpret_cast<void **>(&item)))) {
-            IAIMPFileInfo *finfo = nullptr;
-            if (SUCCEEDED(item->GetValueAsObject(AIMP_PLAYLISTITEM_PROPID_FILEINFO, IID_IAIMPFileInfo, reinterpret_cast<void **>(&finfo)))) {
-                IAIMPString *custom = nullptr;
-                if (SUCCEEDED(finfo->GetValueAsObject(AIMP_FILEINFO_PROPID_FILENAME, IID_IAIMPString, reinterpret_cast<void **>(&custom)))) {
-                    std::wstring url(custom->GetData());
-                    custom->Release();
-
-                    std::wstring id = Tools::TrackIdFromUrl(url);
-                    int result = callback(item, finfo, id);
-                    if (result & FLAG_DELETE_ITEM) {
-                        pl->Delete(item);
-                        finfo->Release();
-                        item->Release();
-                        i--;
-                        n--;
-                        if (result & FLAG_STOP_LOOP) {
-                            pl->EndUpdate();
-                            return;
-                        }
-                        continue;
-                    }
-                    if (result & FLAG_STOP_LOOP) {
-                        finfo->Release();
-                        item->Release();
-                        pl->EndUpdate();
-                        return;
-                    }
-                }
-                finfo->Release();
-            }
-            item->Release();
-        }
-    }
-    pl->EndUpdate();
-}
-
 HWND Plugin::GetMainWindowHandle() {
     HWND handle = NULL;
     if (SUCCEEDED(m_messageDispatcher->Send(AIMP_MSG_PROPERTY_HWND, AIMP_MSG_PROPVALUE_GET, &handle))) {
@@ -518,13 +479,13 @@ void Plugin::UpdatePlaylistMenu() {
     if (!contextMenu) {
         if (AimpMenu *itemContextMenu = AimpMenu::Get(AIMP_MENUID_PLAYER_PLAYLIST_CONTEXT_FUNCTIONS)) {
             contextMenu = new AimpMenu(itemContextMenu->Add(Lang(L"YouTube.Menu\\AddTo"), nullptr, IDB_ICON, [this](IAIMPMenuItem *item) {
-                int valid = 0;
-                ForSelectedTracks([&valid](IAIMPPlaylist *, IAIMPPlaylistItem *, const std::wstring &id) -> int {
-                    if (!id.empty()) valid++;
-                    return 0;
-                });
+                bool valid = false;
+                if (IAIMPPlaylist *pl = GetCurrentPlaylist()) {
+                    valid = !PlaylistIndex::Selection(pl).empty();
+                    pl->Release();
+                }
 
-                item->SetValueAsInt32(AIMP_MENUITEM_PROPID_VISIBLE, valid > 0);
+                item->SetValueAsInt32(AIMP_MENUITEM_PROPID_VISIBLE, valid);
             }, L"ContextMenu"));
             delete itemContextMenu;
         }
@@ -551,22 +512,18 @@ void Plugin::UpdatePlaylistMenu() {
     if (!contextMenu) {
         if (AimpMenu *itemContextMenu = AimpMenu::Get(AIMP_MENUID_PLAYER_PLAYLIST_CONTEXT_FUNCTIONS)) {
             contextMenu = new AimpMenu(itemContextMenu->Add(Lang(L"YouTube.Menu\\RemoveFrom"), nullptr, IDB_ICON, [this](IAIMPMenuItem *item) {
-                int valid = 0;
-                ForSelectedTracks([&valid](IAIMPPlaylist *, IAIMPPlaylistItem *, const std::wstring &id) -> int {
-                    if (!id.empty()) {
-                        for (auto &x : Config::UserPlaylists) {
-                            for (auto &item : x.Items) {
-                                if (id == item) {
-                                    valid++;
-                                    return 0;
-                                }
-                            }
+                bool valid = false;
+                if (IAIMPPlaylist *pl = GetCurrentPlaylist()) {
+                    for (const auto &id : PlaylistIndex::Selection(pl)) {
+                        if (Config::UserPlaylistsContaining(id)) {
+                            valid = true;
+                            break;
                         }
                     }
-                    return 0;
-                });
+                    pl->Release();
+                }
 
-                item->SetValueAsInt32(AIMP_MENUITEM_PROPID_VISIBLE, valid > 0);
+                item->SetValueAsInt32(AIMP_MENUITEM_PROPID_VISIBLE, valid);
             }, L"RemoveContextMenu"));
             delete itemContextMenu;
         }
@@ -583,20 +540,18 @@ void Plugin::UpdatePlaylistMenu() {
                         return 0;
                     });
                 }, 0, [this, &x](IAIMPMenuItem *item) {
-                    int valid = 0;
-                    ForSelectedTracks([&valid, &x](IAIMPPlaylist *, IAIMPPlaylistItem *, const std::wstring &id) -> int {
-                        if (!id.empty()) {
-                            for (auto &item : x.Items) {
-                                if (id == item) {
-                                    valid++;
-                                    return 0;
-                                }
+                    bool valid = false;
+                    if (IAIMPPlaylist *pl = GetCurrentPlaylist()) {
+                        for (const auto &id : PlaylistIndex::Selection(pl)) {
+                            if (x.Items.find(id) != x.Items.end()) {
+                                valid = true;
+                                break;
                             }
                         }
-                        return 0;
-                    });
+                        pl->Release();
+                    }
 
-                    item->SetValueAsInt32(AIMP_MENUITEM_PROPID_VISIBLE, valid > 0);
+                    item->SetValueAsInt32(AIMP_MENUITEM_PROPID_VISIBLE, valid);
                 })->Release();
             }
         }
@@ -619,6 +574,8 @@ void Plugin::setAccessToken(const std::wstring &accessToken, const std::wstring
     Config::SetString(L"AccessToken", m_accessToken);
     Config::SetString(L"RefreshToken", m_refreshToken);
     Config::SetInt64(L"TokenExpires", m_tokenExpireTime);
+
+    MainThread::Run(PlaylistMutations::Resume);
 }
 
 void Plugin::refreshAccessToken(bool synchrounous) {
@@ -638,6 +595,8 @@ void Plugin::refreshAccessToken(bool synchrounous) {
             Config::SetInt64(L"TokenExpires", m_tokenExpireTime);
 
             Timer::SingleShot((d["expires_in"].GetUint() - 30) * 1000, [this] { refreshAccessToken(); });
+
+            MainThread::Run(PlaylistMutations::Resume);
         }
     }, synchrounous);
 }
@@ -73,7 +73,6 @@ public:
     };
 
     void ForSelectedTracks(std::function<int(IAIMPPlaylist *, IAIMPPlaylistItem *, const std::wstring &)>);
-    void ForEveryItem(IAIMPPlaylist *pl, std::function<int(IAIMPPlaylistItem *, IAIMPFileInfo *, const std::wstring &)> callback);
 
     HWND GetMainWindowHandle();
 
@@ -85,18 +84,14 @@ public:
 
     inline IAIMPCore *core() const { return m_core; }
 
-    static void MonitorCallback();
+    static void MonitorCallback(); // Syncs every monitored source now
+    static void MonitorTick();     // Syncs the sources that are due
+    static void StartupCheck();    // CheckOnStartup: syncs the sources that came due while AIMP was closed
     void StartMonitorTimer();
     void KillMonitorTimer();
 
     void UpdatePlaylistMenu();
 
-	//for some fucking reason config->getvalue doesn't work directly in YouTubeAPI::GetStreamUrl
-	std::wstring YoutubeDLCmd() const;
-	int YoutubeDLTimeout() const;
-	void YoutubeDLCmd(std::wstring value);
-	void YoutubeDLTimeout(int value);
-
 private:
     Plugin() : m_messageHook(nullptr), m_playlistManager(nullptr), m_messageDispatcher(nullptr), m_muiService(nullptr), m_monitorTimer(0), m_gdiplusToken(0), m_core(nullptr) {
         AddRef();
@@ -104,6 +99,8 @@ private:
     Plugin(const Plugin &);
     Plugin &operator=(const Plugin &);
 
+    void RefreshUserPlaylists();
+
     static Plugin *m_instance;
 
     bool m_finalized{false};
@@ -114,14 +111,11 @@ private:
     IAIMPServiceMUI *m_muiService;
 
     UINT_PTR m_monitorTimer;
-    std::queue<Config::MonitorUrl> m_monitorPendingUrls;
+    int64_t m_userPlaylistsRefreshed{0};
 
     ULONG_PTR m_gdiplusToken;
     std::wstring m_accessToken;
     std::wstring m_refreshToken;
     int64_t m_tokenExpireTime;
     IAIMPCore *m_core;
-
-	std::wstring m_youtubeDLCmd;
-	int m_youtubeDLTimeout;
 };
\ No newline at end of file
@@ -2,8 +2,12 @@
 #include "resource.h"
 #include "Tools.h"
 #include "YouTubeAPI.h"
+#include "BulkImport.h"
 #include "GdiPlusImageLoader.h"
 #include "AIMPYouTube.h"
+#include <commdlg.h>
+
+#pragma comment(lib, "Comdlg32.lib")
 
 extern HINSTANCE g_hInst;
 
@@ -31,25 +35,55 @@ BOOL CALLBACK AddURLDialog::DlgProc(HWND hwnd, UINT Msg, WPARAM wParam, LPARAM l
             SetDlgItemText(hwnd, IDC_CREATENEW,            Plugin::instance()->Lang(L"YouTube.AddURL\\CreateNew").c_str());
             SetDlgItemText(hwnd, IDOK,                     Plugin::instance()->Lang(L"YouTube.AddURL\\OK").c_str());
             SetDlgItemText(hwnd, IDC_PLAYLISTTITLECAPTION, Plugin::instance()->Lang(L"YouTube.AddURL\\PlaylistName").c_str());
+            std::wstring importFile = Plugin::instance()->Lang(L"YouTube.AddURL\\ImportFile");
+            if (!importFile.empty())
+                SetDlgItemText(hwnd, IDC_IMPORTFILE, importFile.c_str());
             SetFocus(GetDlgItem(hwnd, IDC_YouTubeURL));
         } break;
         case WM_COMMAND: {
             switch (LOWORD(wParam)) {
                 case IDOK: {
-                    wchar_t buf[1024];
-                    GetDlgItemText(hwnd, IDC_YouTubeURL, buf, 1024);
-                    std::wstring url(buf);
+                    // May hold a whole pasted list
+                    std::wstring url(GetWindowTextLength(GetDlgItem(hwnd, IDC_YouTubeURL)) + 1, L'\0');
+                    url.resize(GetDlgItemText(hwnd, IDC_YouTubeURL, &url[0], (int)url.size()));
 
+                    wchar_t buf[1024];
                     GetDlgItemText(hwnd, IDC_PLAYLISTTITLE, buf, 1024);
                     std::wstring playlistTitle(buf);
 
                     bool createnew = SendDlgItemMessage(hwnd, IDC_CREATENEW, BM_GETCHECK, NULL, NULL) == BST_CHECKED;
 
-                    if (!url.empty()) {
+                    std::wstring::size_type begin = url.find_first_not_of(L" \t\r\n");
+                    if (begin != std::wstring::npos && !BulkImport::FromText(url, playlistTitle, createnew)) {
+                        url = url.substr(begin, url.find_last_not_of(L" \t\r\n") - begin + 1);
                         YouTubeAPI::ResolveUrl(url, playlistTitle, createnew);
                     }
                     EndDialog(hwnd, wParam);
                 } break;
+                case IDC_IMPORTFILE: {
+                    wchar_t file[MAX_PATH] = { 0 };
+                    OPENFILENAME ofn = { 0 };
+                    ofn.lStructSize = sizeof(ofn);
+                    ofn.hwndOwner = hwnd;
+                    ofn.lpstrFilter = L"Link lists (*.txt;*.m3u;*.m3u8;*.csv)\0*.txt;*.m3u;*.m3u8;*.csv\0All files (*.*)\0*.*\0";
+                    ofn.lpstrFile = file;
+                    ofn.nMaxFile = MAX_PATH;
+                    ofn.Flags = OFN_FILEMUSTEXIST | OFN_PATHMUSTEXIST | OFN_HIDEREADONLY;
+                    if (!GetOpenFileName(&ofn))
+                        break;
+
+                    wchar_t buf[1024];
+                    GetDlgItemText(hwnd, IDC_PLAYLISTTITLE, buf, 1024);
+                    std::wstring playlistTitle(buf);
+
+                    bool createnew = SendDlgItemMessage(hwnd, IDC_CREATENEW, BM_GETCHECK, NULL, NULL) == BST_CHECKED;
+
+                    if (!BulkImport::FromFile(file, playlistTitle, createnew)) {
+                        MessageBox(hwnd, Plugin::instance()->Lang(L"YouTube.Messages\\CantResolve").c_str(), Plugin::instance()->Lang(L"YouTube.Messages\\Error").c_str(), MB_OK | MB_ICONERROR);
+                        break;
+                    }
+                    EndDialog(hwnd, IDOK);
+                } break;
                 case IDCANCEL:
                     EndDialog(hwnd, wParam);
                 break;
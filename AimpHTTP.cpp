@@ -12,6 +12,7 @@
 bool AimpHTTP::m_initialized = false;
 IAIMPServiceHTTPClient *AimpHTTP::m_httpClient = nullptr;
 std::set<AimpHTTP::EventListener *> AimpHTTP::m_handlers;
+thread_local bool AimpHTTP::m_failed = false;
 
 AimpHTTP::EventListener::EventListener(CallbackFunc callback, bool isFile) : m_isFileStream(isFile), m_callback(callback) {
     AimpHTTP::m_handlers.insert(this);
@@ -51,7 +52,9 @@ void WINAPI AimpHTTP::EventListener::OnComplete(IAIMPErrorInfo *ErrorInfo, BOOL
                 m_stream->Read(buf, s);
 
                 if (m_callback) {
+                    AimpHTTP::m_failed = ErrorInfo && s == 0;
                     m_callback(buf, s);
+                    AimpHTTP::m_failed = false;
                 } else if (m_imageContainer) {
                     if (s <= m_maxSize) {
                         (*m_imageContainer)->SetDataSize(s);
@@ -60,6 +60,9 @@ public:
     static bool DownloadImage(const std::wstring &url, IAIMPImageContainer **Image, int maxSize = 0);
     static bool Post(const std::wstring &url, const std::string &body, CallbackFunc callback, bool synchronous = false);
 
+    // Inside a callback: nothing came back at all (no connection, DNS, timeout), as opposed to an empty body
+    static inline bool Failed() { return m_failed; }
+
 private:
     struct ThreadParams {
         std::string request;
@@ -77,4 +80,5 @@ private:
     static IAIMPServiceHTTPClient *m_httpClient;
 
     static std::set<EventListener *> m_handlers;
+    static thread_local bool m_failed;
 };
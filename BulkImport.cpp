@@ -0,0 +1,282 @@
+#include "BulkImport.h"
+#include "AIMPYouTube.h"
+#include "AimpHTTP.h"
+#include "DurationResolver.h"
+#include "MainThread.h"
+#include "PlaylistIndex.h"
+#include "SDK/apiPlaylists.h"
+#include "Tools.h"
+#include "Utf.h"
+#include <algorithm>
+#include <cstdio>
+
+static const size_t BatchSize  = 50;    // IDs per videos?id= request, the API maximum
+static const int    MaxBatches = 4;
+static const size_t ReadChunk  = 65536; // Bytes read from a file at a time
+
+namespace {
+    // Anything else ends a link: whitespace, quotes, CSV and M3U separators, non-ASCII text
+    inline bool IsUrlChar(wchar_t c) {
+        if (c <= L' ' || c >= 0x7F)
+            return false;
+
+        switch (c) {
+            case L'"': case L'\'': case L',': case L';': case L'<': case L'>':
+            case L'(': case L')': case L'[': case L']': case L'|': case L'`':
+                return false;
+        }
+        return true;
+    }
+}
+
+void BulkImport::Parser::Feed(const wchar_t *text, size_t length) {
+    for (size_t i = 0; i < length; ++i) {
+        if (IsUrlChar(text[i])) {
+            m_token += text[i];
+        } else if (!m_token.empty()) {
+            Token();
+        }
+    }
+}
+
+void BulkImport::Parser::Finish() {
+    if (!m_token.empty())
+        Token();
+}
+
+void BulkImport::Parser::Token() {
+    Entry entry;
+    entry.Kind = YouTubeAPI::ClassifyUrl(m_token, entry.Id);
+    if (m_token.find(L"youtube.com") != std::wstring::npos || m_token.find(L"youtu.be") != std::wstring::npos)
+        m_links++;
+    if (entry.Kind != YouTubeAPI::UrlNone)
+        m_entries.push_back(std::move(entry));
+    m_token.clear();
+}
+
+bool BulkImport::FromText(const std::wstring &text, const std::wstring &playlistTitle, bool createPlaylist) {
+    auto job = std::make_shared<Job>();
+    Parser parser(job->Entries);
+    parser.Feed(text.data(), text.size());
+    parser.Finish();
+    job->Links = parser.Links();
+
+    if (job->Entries.size() < 2)
+        return false;
+    return Start(job, playlistTitle, createPlaylist);
+}
+
+bool BulkImport::FromFile(const std::wstring &path, const std::wstring &playlistTitle, bool createPlaylist) {
+    FILE *file = nullptr;
+    if (_wfopen_s(&file, path.c_str(), L"rb") != 0)
+        return false;
+
+    auto job = std::make_shared<Job>();
+    Parser parser(job->Entries);
+
+    // UTF-8 (or ANSI, links are ASCII either way) or UTF-16 LE with a BOM
+    std::vector<char> buffer(ReadChunk + 1);
+    std::wstring text;
+    bool utf16 = false;
+    bool first = true;
+    size_t carry = 0;
+    size_t read;
+    while ((read = fread(&buffer[carry], 1, ReadChunk - carry, file)) > 0) {
+        size_t length = carry + read;
+        size_t offset = 0;
+        if (first) {
+            first = false;
+            if (length >= 2 && (unsigned char)buffer[0] == 0xFF && (unsigned char)buffer[1] == 0xFE) {
+                utf16 = true;
+                offset = 2;
+            } else if (length >= 3 && (unsigned char)buffer[0] == 0xEF && (unsigned char)buffer[1] == 0xBB && (unsigned char)buffer[2] == 0xBF) {
+                offset = 3;
+            }
+        }
+
+        if (utf16) {
+            carry = (length - offset) % 2;
+            parser.Feed(reinterpret_cast<const wchar_t *>(&buffer[offset]), (length - offset - carry) / 2);
+            if (carry)
+                buffer[0] = buffer[length - 1];
+        } else {
+            // A character cut in two only garbles text around the links
+            Utf::ToUtf16(&buffer[offset], length - offset, text);
+            parser.Feed(text.data(), text.size());
+        }
+    }
+    fclose(file);
+    parser.Finish();
+    job->Links = parser.Links();
+
+    if (job->Entries.empty())
+        return false;
+    return Start(job, playlistTitle, createPlaylist);
+}
+
+bool BulkImport::Start(std::shared_ptr<Job> job, const std::wstring &playlistTitle, bool createPlaylist) {
+    Config::WaitUntilLoaded();
+
+    job->ReferenceName = L"YouTube";
+    job->Playlist = createPlaylist ? Plugin::instance()->GetPlaylist(playlistTitle.empty() ? job->ReferenceName : playlistTitle)
+                                   : Plugin::instance()->GetCurrentPlaylist();
+    if (!job->Playlist)
+        return false;
+    job->PlaylistId = Plugin::instance()->PlaylistId(job->Playlist);
+
+    job->State = std::make_shared<YouTubeAPI::LoadingState>();
+    job->State->InsertPos = -1; // Appended, in input order
+    job->State->ReferenceName = job->ReferenceName;
+    YouTubeAPI::GetExistingTrackIds(job->Playlist, job->State);
+
+    // Only videos that aren't in the playlist or the track cache yet are requested
+    for (const auto &x : job->Entries) {
+        if (x.Kind != YouTubeAPI::UrlVideo || job->State->TrackIds.find(x.Id) != job->State->TrackIds.end() ||
+            job->Details.find(x.Id) != job->Details.end() || job->Waiting.find(x.Id) != job->Waiting.end())
+            continue;
+
+        auto ti = Tools::TrackInfo(x.Id);
+        if (ti && !ti->Name.empty()) {
+            YouTubeAPI::VideoItem v;
+            v.Id = x.Id;
+            v.Title = ti->Name;
+            v.Artwork = ti->Artwork;
+            v.Duration = (int64_t)ti->Duration;
+            job->Details.emplace(x.Id, std::move(v));
+        } else {
+            job->Waiting.insert(x.Id);
+            job->Lookups.push_back(x.Id);
+        }
+    }
+
+    Pump(job);
+    Advance(job);
+    return true;
+}
+
+void BulkImport::Pump(std::shared_ptr<Job> job) {
+    while (job->InFlight < MaxBatches && job->NextLookup < job->Lookups.size()) {
+        SendBatch(job);
+    }
+}
+
+void BulkImport::SendBatch(std::shared_ptr<Job> job) {
+    auto ids = std::make_shared<std::vector<std::wstring>>();
+    std::wstring allIds;
+    for (; job->NextLookup < job->Lookups.size() && ids->size() < BatchSize; job->NextLookup++) {
+        if (!allIds.empty())
+            allIds += L',';
+        allIds += job->Lookups[job->NextLookup];
+        ids->push_back(job->Lookups[job->NextLookup]);
+    }
+
+    std::wstring reqUrl(YouTubeAPI::SourceUrl(YouTubeAPI::UrlVideo, allIds) + L"&key=" TEXT(APP_KEY));
+    if (Plugin::instance()->isConnected())
+        reqUrl += L"\r\nAuthorization: Bearer " + Plugin::instance()->getAccessToken();
+
+    job->InFlight++;
+    job->Requests++;
+    bool started = AimpHTTP::Get(reqUrl, [job, ids](unsigned char *data, int size) {
+        // Decoded here, only the items go to the main thread
+        auto items = std::make_shared<std::vector<YouTubeAPI::VideoItem>>();
+        ResponseDecoder::Response r;
+        if (ResponseDecoder::Decode(reinterpret_cast<char *>(data), r))
+            YouTubeAPI::ParseItems(r, *items);
+
+        MainThread::Post([job, ids, items] {
+            job->InFlight--;
+            for (auto &x : *items) {
+                std::wstring id = x.Id;
+                job->Details.emplace(std::move(id), std::move(x));
+            }
+            // Missing from the response: deleted, private or the request failed
+            for (const auto &id : *ids) {
+                job->Waiting.erase(id);
+            }
+
+            Pump(job);
+            Advance(job);
+        });
+    });
+
+    if (!started) {
+        job->InFlight--;
+        for (const auto &id : *ids) {
+            job->Waiting.erase(id);
+        }
+    }
+}
+
+void BulkImport::Advance(std::shared_ptr<Job> job) {
+    if (job->Loading || job->Finished)
+        return;
+
+    std::vector<YouTubeAPI::VideoItem> run;
+    while (job->Cursor < job->Entries.size()) {
+        const Entry &entry = job->Entries[job->Cursor];
+        if (entry.Kind == YouTubeAPI::UrlVideo) {
+            if (job->Waiting.find(entry.Id) != job->Waiting.end())
+                break; // Its batch isn't back yet
+
+            auto it = job->Details.find(entry.Id);
+            if (it != job->Details.end())
+                run.push_back(it->second);
+            job->Cursor++;
+            continue;
+        }
+
+        // A playlist or channel, what comes before it goes in first
+        Insert(job, run);
+        run.clear();
+        job->Cursor++;
+
+        const std::wstring url = YouTubeAPI::SourceUrl(entry.Kind, entry.Id);
+        auto find = [&](const Config::MonitorUrl &p) -> bool { return p.PlaylistID == job->PlaylistId && p.URL == url; };
+        if (std::find_if(Config::MonitorUrls.begin(), Config::MonitorUrls.end(), find) == Config::MonitorUrls.end()) {
+            Config::MonitorUrls.push_back({ url, job->PlaylistId, job->State->Flags, job->ReferenceName });
+            Config::MarkDirty(Config::ShardMonitors);
+        }
+
+        job->Loading = true;
+        job->State->ReferenceName = job->ReferenceName; // A channel renames it
+        job->Playlist->AddRef(); // The loader releases it when done
+        YouTubeAPI::LoadFromUrl(url, job->Playlist, job->State, [job] {
+            job->Loading = false;
+            job->State->Unresolved.clear(); // Handed to DurationResolver already
+            Advance(job);
+        });
+        return;
+    }
+    Insert(job, run);
+
+    if (job->Cursor == job->Entries.size())
+        Finish(job);
+}
+
+void BulkImport::Insert(std::shared_ptr<Job> job, const std::vector<YouTubeAPI::VideoItem> &items) {
+    if (items.empty())
+        return;
+
+    job->State->ReferenceName = job->ReferenceName;
+    PlaylistIndex::Mutation mutation(job->Playlist);
+    job->Playlist->BeginUpdate();
+    YouTubeAPI::AddItems(job->Playlist, items, job->State);
+    job->Playlist->EndUpdate();
+}
+
+void BulkImport::Finish(std::shared_ptr<Job> job) {
+    job->Finished = true;
+
+    if (!job->State->Unresolved.empty()) {
+        DurationResolver::Enqueue(job->PlaylistId, job->State->Unresolved);
+        DurationResolver::Resolve();
+    }
+    Config::SaveExtendedConfig();
+
+    const ULONGLONG ms = (std::max)(GetTickCount64() - job->Started, 1ULL);
+    DebugW(L"BulkImport: %u links, %u imported (%d added), %d videos requests in %llu ms, %.0f links/s\n",
+           (unsigned)job->Links, (unsigned)job->Entries.size(), job->State->AddedItems, job->Requests, ms, job->Links * 1000.0 / ms);
+
+    job->Playlist->Release();
+    job->Playlist = nullptr;
+}
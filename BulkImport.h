@@ -0,0 +1,82 @@
+#pragma once
+
+#include <windows.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include "YouTubeAPI.h"
+
+// Imports a list of YouTube links: pasted text or a TXT, M3U or CSV file. The
+// input is scanned once, as it's read, and every link classified on the way.
+// Single videos are looked up 50 IDs per videos?id= request, with up to
+// MaxBatches requests in flight, skipping those already in the playlist or
+// the track cache. Playlists and channels go to the regular loader, and are
+// monitored like an added URL.
+//
+// Everything lands in the playlist in input order: a run of videos goes in
+// with one AddList as soon as all of its details are in, a playlist or channel
+// is loaded at its place in the list.
+class BulkImport {
+public:
+    // Return false if there's nothing to import. FromText() also does if the
+    // text holds a single link, that's for YouTubeAPI::ResolveUrl().
+    static bool FromText(const std::wstring &text, const std::wstring &playlistTitle, bool createPlaylist);
+    static bool FromFile(const std::wstring &path, const std::wstring &playlistTitle, bool createPlaylist);
+
+private:
+    struct Entry {
+        YouTubeAPI::UrlKind Kind;
+        std::wstring Id;
+    };
+
+    class Parser {
+    public:
+        explicit Parser(std::vector<Entry> &entries) : m_entries(entries), m_links(0) {}
+
+        void Feed(const wchar_t *text, size_t length); // Links may be split over calls
+        void Finish();
+
+        inline size_t Links() const { return m_links; } // Including the ones that can't be imported
+
+    private:
+        void Token();
+
+        std::vector<Entry> &m_entries;
+        std::wstring m_token;
+        size_t m_links;
+    };
+
+    struct Job {
+        std::vector<Entry> Entries; // In input order
+        std::vector<std::wstring> Lookups; // Video IDs to request
+        std::unordered_map<std::wstring, YouTubeAPI::VideoItem> Details; // Video IDs that can go in
+        std::unordered_set<std::wstring> Waiting; // Requested, details not in yet
+        size_t NextLookup;
+        size_t Cursor; // First entry not in the playlist yet
+        int InFlight;
+        int Requests;
+        bool Loading; // A playlist or channel is being loaded
+        bool Finished;
+        IAIMPPlaylist *Playlist;
+        std::wstring PlaylistId;
+        std::wstring ReferenceName;
+        std::shared_ptr<YouTubeAPI::LoadingState> State;
+        size_t Links;
+        ULONGLONG Started;
+
+        Job() : NextLookup(0), Cursor(0), InFlight(0), Requests(0), Loading(false), Finished(false), Playlist(nullptr), Links(0), Started(GetTickCount64()) {}
+    };
+
+    static bool Start(std::shared_ptr<Job> job, const std::wstring &playlistTitle, bool createPlaylist);
+    static void Pump(std::shared_ptr<Job> job);
+    static void SendBatch(std::shared_ptr<Job> job);
+    static void Advance(std::shared_ptr<Job> job);
+    static void Insert(std::shared_ptr<Job> job, const std::vector<YouTubeAPI::VideoItem> &items);
+    static void Finish(std::shared_ptr<Job> job);
+
+    BulkImport();
+    BulkImport(const BulkImport &);
+    BulkImport &operator=(const BulkImport &);
+};
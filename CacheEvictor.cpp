@@ -0,0 +1,167 @@
+#include "CacheEvictor.h"
+
+#include "AIMPYouTube.h"
+#include "Config.h"
+#include "Timer.h"
+#include "Tools.h"
+#include "TrackInfoStore.h"
+#include "SDK/apiPlaylists.h"
+#include <ctime>
+#include <algorithm>
+
+static const unsigned int TickInterval  = 1000;    // ms between two slices
+static const int64_t      CycleInterval = 10 * 60; // s between two sweeps
+static const int          PinSlice      = 2000;    // playlist rows scanned per tick
+static const size_t       SweepSlice    = 1000;    // cache entries visited per tick
+
+UINT_PTR CacheEvictor::m_timer = 0;
+CacheEvictor::Phase CacheEvictor::m_phase = CacheEvictor::Idle;
+int64_t CacheEvictor::m_nextCycle = 0;
+std::vector<IAIMPPlaylist *> CacheEvictor::m_playlists;
+int CacheEvictor::m_itemIndex = 0;
+std::unordered_set<std::wstring> CacheEvictor::m_pinned;
+std::vector<std::wstring> CacheEvictor::m_keys;
+size_t CacheEvictor::m_hand = 0;
+int CacheEvictor::m_pass = 0;
+int CacheEvictor::m_evicted = 0;
+
+void CacheEvictor::Start() {
+    if (m_timer)
+        return;
+
+    m_phase = Idle;
+    m_nextCycle = std::time(nullptr) + 60; // Leave the startup alone
+    m_timer = Timer::Schedule(TickInterval, Tick);
+}
+
+void CacheEvictor::Stop() {
+    if (m_timer) {
+        Timer::Cancel(m_timer);
+        m_timer = 0;
+    }
+    for (auto pl : m_playlists)
+        pl->Release();
+
+    m_playlists.clear();
+    m_pinned.clear();
+    m_keys.clear();
+    m_phase = Idle;
+}
+
+void CacheEvictor::Tick() {
+    switch (m_phase) {
+        case Idle:
+            if (std::time(nullptr) >= m_nextCycle && Config::IsLoaded())
+                BeginCycle();
+        break;
+        case PinPlaylists: PinStep(); break;
+        case Sweep:        SweepStep(); break;
+    }
+}
+
+void CacheEvictor::BeginCycle() {
+    m_nextCycle = std::time(nullptr) + CycleInterval;
+
+    int maxEntries = Config::Current().CacheMaxEntries;
+    int maxAgeDays = Config::Current().CacheMaxAgeDays;
+    if (maxAgeDays <= 0 && (maxEntries <= 0 || Config::TrackInfos.Size() <= (size_t)maxEntries))
+        return;
+
+    // Pinned: exclusions, user playlists and everything in a loaded AIMP playlist
+    m_pinned = Config::TrackExclusions;
+    for (const auto &x : Config::UserPlaylists) {
+        m_pinned.insert(x.Items.begin(), x.Items.end());
+    }
+    Plugin::instance()->ForAllPlaylists([](IAIMPPlaylist *pl, const std::wstring &) {
+        m_playlists.push_back(pl);
+    });
+
+    m_itemIndex = 0;
+    m_phase = PinPlaylists;
+}
+
+void CacheEvictor::PinStep() {
+    if (m_playlists.empty()) {
+        m_keys = Config::TrackInfos.Keys();
+        m_hand = 0;
+        m_pass = 0;
+        m_evicted = 0;
+        m_phase = Sweep;
+        return;
+    }
+
+    IAIMPPlaylist *pl = m_playlists.back();
+    int n = pl->GetItemCount();
+    int end = (std::min)(n, m_itemIndex + PinSlice);
+    for (int i = m_itemIndex; i < end; ++i) {
+        IAIMPPlaylistItem *item = nullptr;
+        if (SUCCEEDED(pl->GetItem(i, IID_IAIMPPlaylistItem, reinterpret_cast<void **>(&item)))) {
+            IAIMPString *url = nullptr;
+            if (SUCCEEDED(item->GetValueAsObject(AIMP_PLAYLISTITEM_PROPID_FILENAME, IID_IAIMPString, reinterpret_cast<void **>(&url)))) {
+                std::wstring id = Tools::TrackIdFromUrl(url->GetData());
+                if (!id.empty())
+                    m_pinned.insert(id);
+
+                url->Release();
+            }
+            item->Release();
+        }
+    }
+    m_itemIndex = end;
+
+    if (end >= n) {
+        pl->Release();
+        m_playlists.pop_back();
+        m_itemIndex = 0;
+    }
+}
+
+void CacheEvictor::SweepStep() {
+    const int64_t now = std::time(nullptr);
+    const Config::Settings &settings = Config::Current();
+    const int64_t maxAge = int64_t(settings.CacheMaxAgeDays) * 24 * 60 * 60;
+    const int maxEntries = settings.CacheMaxEntries;
+
+    size_t end = (std::min)(m_keys.size(), m_hand + SweepSlice);
+    for (; m_hand < end; ++m_hand) {
+        const std::wstring &id = m_keys[m_hand];
+        if (m_pinned.find(id) != m_pinned.end())
+            continue;
+
+        int64_t lastAccess = Config::TrackInfos.LastAccess(id);
+        if (lastAccess < 0)
+            continue;
+
+        bool evict = maxAge > 0 && now - lastAccess > maxAge;
+        if (!evict && maxEntries > 0 && Config::TrackInfos.Size() > (size_t)maxEntries) {
+            // Second chance for anything touched since the hand last passed
+            if (Config::TrackInfos.ClearReferenced(id))
+                continue;
+
+            evict = true;
+        }
+
+        if (evict && Config::TrackInfos.Erase(id)) {
+            m_evicted++;
+        }
+    }
+
+    if (m_hand >= m_keys.size()) {
+        if (maxEntries > 0 && Config::TrackInfos.Size() > (size_t)maxEntries && ++m_pass < 2) {
+            m_hand = 0;
+            return;
+        }
+        EndCycle();
+    }
+}
+
+void CacheEvictor::EndCycle() {
+    if (m_evicted > 0) {
+        DebugW(L"CacheEvictor: evicted %d entries, %d left\n", m_evicted, (int)Config::TrackInfos.Size());
+        Config::SaveCache();
+    }
+
+    std::unordered_set<std::wstring>().swap(m_pinned);
+    std::vector<std::wstring>().swap(m_keys);
+    m_phase = Idle;
+}
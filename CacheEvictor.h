@@ -0,0 +1,46 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_set>
+#include <windows.h>
+
+class IAIMPPlaylist;
+
+// Bounds Config::TrackInfos by entry count and age. Runs as a CLOCK sweep split
+// into small slices on a timer, so no single tick walks the whole cache.
+class CacheEvictor {
+public:
+    static void Start();
+    static void Stop();
+
+private:
+    enum Phase {
+        Idle,
+        PinPlaylists,
+        Sweep
+    };
+
+    static void Tick();
+    static void BeginCycle();
+    static void PinStep();
+    static void SweepStep();
+    static void EndCycle();
+
+    static UINT_PTR m_timer;
+    static Phase m_phase;
+    static int64_t m_nextCycle;
+
+    static std::vector<IAIMPPlaylist *> m_playlists;
+    static int m_itemIndex;
+
+    static std::unordered_set<std::wstring> m_pinned;
+    static std::vector<std::wstring> m_keys;
+    static size_t m_hand;
+    static int m_pass;
+    static int m_evicted;
+
+    CacheEvictor();
+    CacheEvictor(const CacheEvictor &);
+    CacheEvictor &operator=(const CacheEvictor &);
+};
@@ -1,4 +1,5 @@
 #include "Config.h"
+#include "TrackInfoStore.h"
 
 #include "AIMPString.h"
 #include "AIMPYouTube.h"
@@ -6,7 +7,10 @@
 #include "SDK/apiCore.h"
 #include "AimpHTTP.h"
 #include "Tools.h"
-#include <regex>
+#include "MainThread.h"
+#include "ResponseDecoder.h"
+#include <thread>
+#include <algorithm>
 #include "rapidjson/document.h"
 #include "rapidjson/stringbuffer.h"
 #include "rapidjson/prettywriter.h"
@@ -19,7 +23,32 @@ std::wstring Config::m_configFolder;
 std::unordered_set<std::wstring> Config::TrackExclusions;
 std::vector<Config::MonitorUrl> Config::MonitorUrls;
 std::vector<Config::Playlist> Config::UserPlaylists;
-std::unordered_map<std::wstring, Config::TrackInfo> Config::TrackInfos;
+Config::TrackInfoStore Config::TrackInfos;
+
+std::atomic<const Config::Settings *> Config::m_settings{ nullptr };
+std::vector<std::unique_ptr<Config::Settings>> Config::m_settingsHistory;
+const Config::Settings Config::m_defaultSettings;
+std::vector<Config::SettingsListener> Config::m_settingsListeners;
+
+int Config::m_dirtyShards = Config::ShardNone;
+std::atomic<unsigned> Config::m_membershipVersion{ 1 };
+unsigned Config::m_membershipBuilt = 0;
+std::unordered_map<std::wstring, std::vector<std::wstring>> Config::m_membership;
+std::unordered_set<std::wstring> Config::m_dirtyPlaylists;
+std::unordered_set<std::wstring> Config::m_savedPlaylists;
+
+std::thread Config::m_loader;
+std::mutex Config::m_loadMutex;
+std::condition_variable Config::m_loadCondition;
+std::atomic<bool> Config::m_loaded{ false };
+
+Config::Settings::Settings()
+    : CheckOnStartup(true), CheckEveryEnabled(true), CheckEveryHours(1), MonitorUserPlaylists(true),
+      LimitUserStream(false), LimitUserStreamValue(5000), YoutubeDLCmd(L"-f best[ext=mp4]/best"), YoutubeDLTimeout(30),
+      CacheMaxEntries(20000), CacheMaxAgeDays(180), PushEnabled(false), PushPort(35911), DurationBatches(4), ConcurrentSyncs(4),
+      ValidateEveryHours(24), ValidateRemove(false), RefreshAfterDays(30) {
+
+}
 
 bool Config::Init(IAIMPCore *core) {
     IAIMPString *str = nullptr;
@@ -28,12 +57,92 @@ bool Config::Init(IAIMPCore *core) {
         CreateDirectory(m_configFolder.c_str(), NULL);
         str->Release();
     }
-    return SUCCEEDED(core->QueryInterface(IID_IAIMPConfig, reinterpret_cast<void **>(&m_config))) && m_config;
+    if (FAILED(core->QueryInterface(IID_IAIMPConfig, reinterpret_cast<void **>(&m_config))) || !m_config)
+        return false;
+
+    LoadSettings();
+    return true;
 }
 
 void Config::Deinit() {
+    if (m_loader.joinable())
+        m_loader.join();
+
+    m_loaded = false;
+
     if (m_config)
         m_config->Release();
+
+    m_settingsListeners.clear();
+
+    // HTTP callbacks and the decoder thread may still read Current() on their
+    // way out: the last snapshot stays published, the others are freed with the DLL
+}
+
+void Config::LoadSettings() {
+    Settings *s = new Settings();
+    s->CheckOnStartup       = GetInt32(L"CheckOnStartup", s->CheckOnStartup) != 0;
+    s->CheckEveryEnabled    = GetInt32(L"CheckEveryEnabled", s->CheckEveryEnabled) == 1;
+    s->CheckEveryHours      = GetInt32(L"CheckEveryHours", s->CheckEveryHours);
+    s->MonitorUserPlaylists = GetInt32(L"MonitorUserPlaylists", s->MonitorUserPlaylists) != 0;
+    s->LimitUserStream      = GetInt32(L"LimitUserStream", s->LimitUserStream) != 0;
+    s->LimitUserStreamValue = GetInt32(L"LimitUserStreamValue", s->LimitUserStreamValue);
+    s->YoutubeDLCmd         = GetString(L"YoutubeDL", s->YoutubeDLCmd);
+    s->YoutubeDLTimeout     = GetInt32(L"YoutubeDLTimeout", s->YoutubeDLTimeout);
+    s->UserYTName           = GetString(L"UserYTName");
+    s->CacheMaxEntries      = GetInt32(L"CacheMaxEntries", s->CacheMaxEntries);
+    s->CacheMaxAgeDays      = GetInt32(L"CacheMaxAgeDays", s->CacheMaxAgeDays);
+    s->PushEnabled          = GetInt32(L"PushEnabled", s->PushEnabled) != 0;
+    s->PushCallbackUrl      = GetString(L"PushCallbackUrl");
+    s->PushPort             = GetInt32(L"PushPort", s->PushPort);
+    s->DurationBatches      = GetInt32(L"DurationBatches", s->DurationBatches);
+    s->ConcurrentSyncs      = GetInt32(L"ConcurrentSyncs", s->ConcurrentSyncs);
+    s->ValidateEveryHours   = GetInt32(L"ValidateEveryHours", s->ValidateEveryHours);
+    s->ValidateRemove       = GetInt32(L"ValidateRemove", s->ValidateRemove) != 0;
+    s->RefreshAfterDays     = GetInt32(L"RefreshAfterDays", s->RefreshAfterDays);
+
+    PublishSettings(s);
+}
+
+void Config::SaveSettings(const Settings &settings) {
+    SetInt32(L"CheckOnStartup", settings.CheckOnStartup);
+    SetInt32(L"CheckEveryEnabled", settings.CheckEveryEnabled);
+    SetInt32(L"CheckEveryHours", settings.CheckEveryHours);
+    SetInt32(L"MonitorUserPlaylists", settings.MonitorUserPlaylists);
+    SetInt32(L"LimitUserStream", settings.LimitUserStream);
+    SetInt32(L"LimitUserStreamValue", settings.LimitUserStreamValue);
+    SetString(L"YoutubeDL", settings.YoutubeDLCmd);
+    SetInt32(L"YoutubeDLTimeout", settings.YoutubeDLTimeout);
+    SetString(L"UserYTName", settings.UserYTName);
+    SetInt32(L"CacheMaxEntries", settings.CacheMaxEntries);
+    SetInt32(L"CacheMaxAgeDays", settings.CacheMaxAgeDays);
+    SetInt32(L"PushEnabled", settings.PushEnabled);
+    SetString(L"PushCallbackUrl", settings.PushCallbackUrl);
+    SetInt32(L"PushPort", settings.PushPort);
+    SetInt32(L"DurationBatches", settings.DurationBatches);
+    SetInt32(L"ConcurrentSyncs", settings.ConcurrentSyncs);
+    SetInt32(L"ValidateEveryHours", settings.ValidateEveryHours);
+    SetInt32(L"ValidateRemove", settings.ValidateRemove);
+    SetInt32(L"RefreshAfterDays", settings.RefreshAfterDays);
+
+    PublishSettings(new Settings(settings));
+}
+
+void Config::OnSettingsChanged(SettingsListener listener) {
+    if (listener)
+        m_settingsListeners.push_back(listener);
+}
+
+void Config::PublishSettings(Settings *settings) {
+    const Settings *old = m_settings.load(std::memory_order_relaxed);
+    m_settingsHistory.emplace_back(settings);
+    m_settings.store(settings, std::memory_order_release);
+
+    if (old) {
+        for (const auto &listener : m_settingsListeners) {
+            listener(*old, *settings);
+        }
+    }
 }
 
 void Config::Delete(const std::wstring &name) {
@@ -78,96 +187,299 @@ int32_t Config::GetInt32(const std::wstring &name, const int32_t &def) {
     return def;
 }
 
-void Config::SaveExtendedConfig() {
-    std::wstring configFile = m_configFolder + L"Config.json";
-    FILE *file = nullptr;
-    if (_wfopen_s(&file, configFile.c_str(), L"wb") == 0) {
+namespace {
+    typedef rapidjson::GenericDocument<rapidjson::UTF16<>> Document16;
+    typedef rapidjson::GenericValue<rapidjson::UTF16<>> Value16;
+
+    std::wstring PlaylistShardFile(const std::wstring &folder, const std::wstring &playlistId) {
+        return folder + L"Playlist." + playlistId + L".json";
+    }
+
+    // Writes to a temporary file first, so an interrupted save never leaves a truncated shard
+    template <typename Body>
+    bool WriteJson(const std::wstring &path, Body body) {
+        std::wstring tmp = path + L".tmp";
+        FILE *file = nullptr;
+        if (_wfopen_s(&file, tmp.c_str(), L"wb") != 0)
+            return false;
+
         using namespace rapidjson;
         char writeBuffer[65536];
 
         FileWriteStream stream(file, writeBuffer, sizeof(writeBuffer));
         PrettyWriter<decltype(stream), UTF16<>> writer(stream);
+        body(writer);
+        stream.Flush();
+        const bool written = !ferror(file);
+        fclose(file);
 
-        writer.StartObject();
-        writer.String(L"Exclusions");
-        writer.StartArray();
-        for (const auto &trackId : TrackExclusions) {
-            writer.String(trackId.c_str());
-        }
-        writer.EndArray();
-
-        writer.String(L"MonitorURLs");
-        writer.StartArray();
-        for (const auto &monitorUrl : MonitorUrls) {
-            writer << monitorUrl;
+        if (!written || !MoveFileEx(tmp.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+            DeleteFile(tmp.c_str());
+            return false;
         }
-        writer.EndArray();
+        return true;
+    }
 
-        writer.String(L"UserPlaylists");
-        writer.StartArray();
-        for (const auto &playlist : UserPlaylists) {
-            writer << playlist;
-        }
-        writer.EndArray();
+    bool ReadJson(const std::wstring &path, Document16 &d) {
+        FILE *file = nullptr;
+        if (_wfopen_s(&file, path.c_str(), L"rb") != 0)
+            return false;
 
-        writer.EndObject();
+        using namespace rapidjson;
+        char buffer[65536];
 
+        FileReadStream stream(file, buffer, sizeof(buffer));
+        d.ParseStream<0, UTF8<>, decltype(stream)>(stream);
         fclose(file);
+        return !d.HasParseError();
     }
+}
 
+void Config::SaveExtendedConfig() {
+    WaitUntilLoaded(); // Saving now would overwrite the shards with empty containers
+    SaveShards();
     SaveCache();
 }
 
+bool Config::SaveShards() {
+    std::wstring folder = m_configFolder + L"Config\\";
+    CreateDirectory(folder.c_str(), NULL);
+
+    bool ok = true;
+    if (m_dirtyShards & ShardExclusions) {
+        ok &= WriteJson(folder + L"Exclusions.json", [](MonitorUrl::Writer &writer) {
+            writer.StartArray();
+            for (const auto &trackId : TrackExclusions) {
+                writer.String(trackId.c_str());
+            }
+            writer.EndArray();
+        });
+    }
+
+    if (m_dirtyShards & ShardMonitors) {
+        ok &= WriteJson(folder + L"Monitors.json", [](MonitorUrl::Writer &writer) {
+            writer.StartArray();
+            for (const auto &monitorUrl : MonitorUrls) {
+                writer << monitorUrl;
+            }
+            writer.EndArray();
+        });
+    }
+
+    const bool allPlaylists = (m_dirtyShards & ShardAllPlaylists) == ShardAllPlaylists;
+    for (const auto &playlist : UserPlaylists) {
+        if (allPlaylists || m_dirtyPlaylists.find(playlist.ID) != m_dirtyPlaylists.end() ||
+            m_savedPlaylists.find(playlist.ID) == m_savedPlaylists.end()) {
+            if (WriteJson(PlaylistShardFile(folder, playlist.ID), [&playlist](Playlist::Writer &writer) { writer << playlist; })) {
+                if (m_savedPlaylists.insert(playlist.ID).second)
+                    m_dirtyShards |= ShardPlaylistIndex;
+            } else {
+                ok = false;
+            }
+        }
+    }
+
+    if ((m_dirtyShards & ShardPlaylistIndex) || m_savedPlaylists.size() != UserPlaylists.size()) {
+        std::unordered_set<std::wstring> current;
+        ok &= WriteJson(folder + L"Playlists.json", [&current](Playlist::Writer &writer) {
+            writer.StartArray();
+            for (const auto &playlist : UserPlaylists) {
+                writer.String(playlist.ID.c_str(), playlist.ID.size());
+                current.insert(playlist.ID);
+            }
+            writer.EndArray();
+        });
+
+        // Drop shards of playlists that are gone
+        for (auto it = m_savedPlaylists.begin(); it != m_savedPlaylists.end();) {
+            if (current.find(*it) == current.end()) {
+                DeleteFile(PlaylistShardFile(folder, *it).c_str());
+                it = m_savedPlaylists.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    m_dirtyShards = ShardNone;
+    m_dirtyPlaylists.clear();
+    return ok;
+}
+
 void Config::LoadExtendedConfig() {
     TrackExclusions.clear();
     MonitorUrls.clear();
+    UserPlaylists.clear();
+    m_membershipVersion++;
+
+    m_dirtyShards = ShardNone;
+    m_dirtyPlaylists.clear();
+    m_savedPlaylists.clear();
+
+    if (!LoadShards()) {
+        LoadLegacyConfig();
+    }
+    LoadCache();
+}
+
+void Config::BeginLoadExtendedConfig(std::function<void()> onLoaded) {
+    if (m_loader.joinable())
+        m_loader.join();
+
+    m_loaded = false;
+    m_loader = std::thread([onLoaded] {
+        ULONGLONG start = GetTickCount64();
+        LoadExtendedConfig();
 
+        {
+            std::lock_guard<std::mutex> lock(m_loadMutex);
+            m_loaded = true;
+        }
+        m_loadCondition.notify_all();
+
+        DebugW(L"Config: extended config loaded in %llu ms\n", GetTickCount64() - start);
+        if (onLoaded)
+            MainThread::Post(onLoaded);
+    });
+}
+
+void Config::WaitForLoader() {
+    ULONGLONG start = GetTickCount64();
+
+    std::unique_lock<std::mutex> lock(m_loadMutex);
+    m_loadCondition.wait(lock, [] { return m_loaded.load(); });
+
+    DebugW(L"Config: waited %llu ms for extended config\n", GetTickCount64() - start);
+}
+
+bool Config::LoadShards() {
+    std::wstring folder = m_configFolder + L"Config\\";
+
+    std::vector<std::wstring> files = { folder + L"Exclusions.json", folder + L"Monitors.json" };
+
+    Document16 index;
+    if (ReadJson(folder + L"Playlists.json", index) && index.IsArray()) {
+        for (auto x = index.Begin(), e = index.End(); x != e; x++) {
+            if ((*x).IsString()) {
+                files.push_back(PlaylistShardFile(folder, (*x).GetString()));
+            }
+        }
+    } else {
+        // Missing or truncated index: the other shards are still good, only the
+        // playlist order is lost. Legacy config only if there are no shards at all,
+        // an empty config saved over them would lose them for good.
+        WIN32_FIND_DATA found;
+        HANDLE find = FindFirstFile((folder + L"Playlist.*.json").c_str(), &found);
+        if (find != INVALID_HANDLE_VALUE) {
+            do {
+                files.push_back(folder + found.cFileName);
+            } while (FindNextFile(find, &found));
+            FindClose(find);
+        }
+
+        if (files.size() == 2 && GetFileAttributes(files[0].c_str()) == INVALID_FILE_ATTRIBUTES && GetFileAttributes(files[1].c_str()) == INVALID_FILE_ATTRIBUTES)
+            return false;
+
+        DebugW(L"Config: playlist index unreadable, %u playlist shards found\n", (unsigned)(files.size() - 2));
+        m_dirtyShards |= ShardPlaylistIndex; // Written again on the next save
+    }
+
+    // Shards are independent, parse them on a few threads and convert afterwards
+    std::vector<Document16> docs(files.size());
+    std::atomic<size_t> next(0);
+    auto worker = [&] {
+        for (size_t i = next++; i < files.size(); i = next++) {
+            ReadJson(files[i], docs[i]);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    size_t threadCount = (std::min)(files.size(), (size_t)(std::max)(1u, std::thread::hardware_concurrency())) - 1;
+    for (size_t i = 0; i < threadCount; ++i) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto &t : threads) {
+        t.join();
+    }
+
+    if (docs[0].IsArray()) {
+        for (auto x = docs[0].Begin(), e = docs[0].End(); x != e; x++) {
+            if ((*x).IsString()) {
+                TrackExclusions.insert((*x).GetString());
+            }
+        }
+    }
+    if (docs[1].IsArray()) {
+        for (auto x = docs[1].Begin(), e = docs[1].End(); x != e; x++) {
+            if ((*x).IsObject()) {
+                MonitorUrls.push_back(*x);
+            }
+        }
+    }
+    for (size_t i = 2; i < docs.size(); ++i) {
+        if (docs[i].IsObject()) {
+            UserPlaylists.push_back(docs[i]);
+            m_savedPlaylists.insert(UserPlaylists.back().ID);
+        } else if (GetFileAttributes(files[i].c_str()) == INVALID_FILE_ATTRIBUTES) {
+            DebugW(L"Config: playlist shard %s is missing\n", files[i].c_str());
+        } else {
+            // Moved aside, the next index write drops its ID and the data would be lost for good
+            MoveFileEx(files[i].c_str(), (files[i] + L".bad").c_str(), MOVEFILE_REPLACE_EXISTING);
+            DebugW(L"Config: playlist shard %s is unreadable, kept as .bad\n", files[i].c_str());
+        }
+    }
+    return true;
+}
+
+void Config::LoadLegacyConfig() {
     std::wstring configFile = m_configFolder + L"Config.json";
-    FILE *file = nullptr;
-    if (_wfopen_s(&file, configFile.c_str(), L"rb") == 0) {
-        using namespace rapidjson;
-        char buffer[65536];
 
-        FileReadStream stream(file, buffer, sizeof(buffer));
-        GenericDocument<UTF16<>> d;
-        d.ParseStream<0, UTF8<>, decltype(stream)>(stream);
+    Document16 d;
+    if (!ReadJson(configFile, d))
+        return;
 
-        if (d.IsObject()) {
-            if (d.HasMember(L"Exclusions")) {
-                const GenericValue<UTF16<>> &v = d[L"Exclusions"];
-                if (v.IsArray()) {
-                    for (auto x = v.Begin(), e = v.End(); x != e; x++) {
-                        TrackExclusions.insert((*x).GetString());
-                    }
+    if (d.IsObject()) {
+        if (d.HasMember(L"Exclusions")) {
+            const Value16 &v = d[L"Exclusions"];
+            if (v.IsArray()) {
+                for (auto x = v.Begin(), e = v.End(); x != e; x++) {
+                    TrackExclusions.insert((*x).GetString());
                 }
             }
-            if (d.HasMember(L"MonitorURLs")) {
-                const GenericValue<UTF16<>> &v = d[L"MonitorURLs"];
-                if (v.IsArray()) {
-                    for (auto x = v.Begin(), e = v.End(); x != e; x++) {
-                        if ((*x).IsObject()) {
-                            MonitorUrls.push_back(*x);
-                        }
+        }
+        if (d.HasMember(L"MonitorURLs")) {
+            const Value16 &v = d[L"MonitorURLs"];
+            if (v.IsArray()) {
+                for (auto x = v.Begin(), e = v.End(); x != e; x++) {
+                    if ((*x).IsObject()) {
+                        MonitorUrls.push_back(*x);
                     }
                 }
             }
-            if (d.HasMember(L"UserPlaylists")) {
-                const GenericValue<UTF16<>> &v = d[L"UserPlaylists"];
-                if (v.IsArray()) {
-                    for (auto x = v.Begin(), e = v.End(); x != e; x++) {
-                        if ((*x).IsObject()) {
-                            UserPlaylists.push_back(*x);
-                        }
+        }
+        if (d.HasMember(L"UserPlaylists")) {
+            const Value16 &v = d[L"UserPlaylists"];
+            if (v.IsArray()) {
+                for (auto x = v.Begin(), e = v.End(); x != e; x++) {
+                    if ((*x).IsObject()) {
+                        UserPlaylists.push_back(*x);
                     }
                 }
             }
         }
-        fclose(file);
     }
-    LoadCache();
+
+    // Migrate to shards, keep the old file around just in case
+    MarkDirty(ShardAll);
+    if (SaveShards()) {
+        MoveFileEx(configFile.c_str(), (configFile + L".bak").c_str(), MOVEFILE_REPLACE_EXISTING);
+    }
 }
 
 void Config::SaveCache() {
+    WaitUntilLoaded();
+
     std::wstring configFile = m_configFolder + L"Cache.json";
     FILE *file = nullptr;
     if (_wfopen_s(&file, configFile.c_str(), L"wb") == 0) {
@@ -177,10 +489,13 @@ void Config::SaveCache() {
         FileWriteStream stream(file, writeBuffer, sizeof(writeBuffer));
         Writer<decltype(stream), UTF16<>> writer(stream);
 
+        std::vector<std::pair<TrackInfoHandle, int64_t>> infos;
+        TrackInfos.Snapshot(infos);
+
         writer.StartObject();
-        for (const auto &ti : TrackInfos) {
-            writer.String(ti.first.c_str());
-            writer << ti.second;
+        for (const auto &ti : infos) {
+            writer.String(ti.first->Id.c_str(), ti.first->Id.size());
+            ti.first->Write(writer, ti.second);
         }
         writer.EndObject();
 
@@ -189,7 +504,7 @@ void Config::SaveCache() {
 }
 
 void Config::LoadCache() {
-    TrackInfos.clear();
+    TrackInfos.Clear();
 
     std::wstring configFile = m_configFolder + L"Cache.json";
     FILE *file = nullptr;
@@ -203,16 +518,36 @@ void Config::LoadCache() {
 
         if (d.IsObject()) {
             for (auto x = d.MemberBegin(), e = d.MemberEnd(); x != e; x++) {
-                std::wstring id = (*x).name.GetString();
-                TrackInfos[id] = (*x).value;
-                TrackInfos[id].Id = id;
+                TrackInfo ti((*x).value);
+                ti.Id = (*x).name.GetString();
+                TrackInfos.Restore(ti, ti.LastAccess);
             }
         }
         fclose(file);
     }
 }
 
+const std::vector<std::wstring> *Config::UserPlaylistsContaining(const std::wstring &videoId) {
+    WaitUntilLoaded();
+
+    const unsigned version = m_membershipVersion.load(std::memory_order_relaxed);
+    if (version != m_membershipBuilt) {
+        m_membership.clear();
+        for (const auto &playlist : UserPlaylists) {
+            for (const auto &id : playlist.Items) {
+                m_membership[id].push_back(playlist.ID);
+            }
+        }
+        m_membershipBuilt = version;
+    }
+
+    auto it = m_membership.find(videoId);
+    return it != m_membership.end() ? &it->second : nullptr;
+}
+
 bool Config::ResolveTrackInfo(const std::wstring &id) {
+    WaitUntilLoaded();
+
     std::wstring url(L"https://www.googleapis.com/youtube/v3/videos?part=contentDetails%2Csnippet&hl=" + Plugin::instance()->Lang(L"YouTube\\YouTubeLang") + L"&id=" + id);
     url += L"&key=" TEXT(APP_KEY);
     if (Plugin::instance()->isConnected())
@@ -224,37 +559,19 @@ bool Config::ResolveTrackInfo(const std::wstring &id) {
     auto permalink = L"https://www.youtube.com/watch?v=" + id;
 
     AimpHTTP::Get(url, [&](unsigned char *data, int size) {
-        rapidjson::Document d;
-        d.Parse(reinterpret_cast<const char *>(data));
+        ResponseDecoder::Response r;
+        if (ResponseDecoder::Decode(reinterpret_cast<char *>(data), r) && !r.Items.empty()) {
+            const ResponseDecoder::Item &item = r.Items[0];
 
-        if (d.IsObject() && d.HasMember("items") && d["items"].IsArray() && d["items"].Size() > 0) {
-            auto &snippet = d["items"][0]["snippet"];
-            auto &contentDetails = d["items"][0]["contentDetails"];
-
-            title = Tools::ToWString(snippet["title"]);
+            title = item.Title;
             if (title != L"Deleted video" && title != L"Private video") {
-                if (contentDetails.IsObject() && contentDetails.HasMember("duration")) {
-                    std::wstring duration = Tools::ToWString(contentDetails["duration"]);
-
-                    std::wregex re(L"PT(?:([0-9]+)H)?(?:([0-9]+)M)?(?:([0-9]+)S)?");
-                    std::wsmatch match;
-                    if (std::regex_match(duration, match, re)) {
-                        auto h = match[1].matched ? std::stoll(match[1].str()) : 0;
-                        auto m = match[2].matched ? std::stoll(match[2].str()) : 0;
-                        auto s = match[3].matched ? std::stoll(match[3].str()) : 0;
-                        videoDuration = h * 3600 + m * 60 + s;
-                    }
-                }
-
-                if (snippet.HasMember("thumbnails") && snippet["thumbnails"].IsObject() && snippet["thumbnails"].HasMember("high") && snippet["thumbnails"]["high"].HasMember("url")) {
-                    artwork = Tools::ToWString(snippet["thumbnails"]["high"]["url"]);
-                }
-
+                videoDuration = item.Duration;
+                artwork = item.Artwork;
                 result = true;
             }
         }
 
-        TrackInfos[id] = TrackInfo(title, id, permalink, artwork, videoDuration);
+        TrackInfos.Put(TrackInfo(title, id, permalink, artwork, videoDuration));
 
         Config::SaveCache();
     }, true);
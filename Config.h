@@ -4,8 +4,15 @@
 #include <unordered_set>
 #include <unordered_map>
 #include <vector>
+#include <atomic>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include "SDK/apiCore.h"
 #include <cstdint>
+#include <ctime>
 #include "rapidjson/document.h"
 #include "rapidjson/prettywriter.h"
 #include "rapidjson/filewritestream.h"
@@ -21,21 +28,38 @@ public:
         std::wstring PlaylistID;
         int Flags;
         std::wstring GroupName;
+        int64_t LastFullSync; // Newest-first sources are otherwise only synced up to the first known items
+
+        // Scheduling state, see MonitorEngine
+        int64_t LastCheck;
+        int64_t LastChange;
+        int64_t NextDue;
+        int Failures;
 
         typedef rapidjson::PrettyWriter<rapidjson::FileWriteStream, rapidjson::UTF16<>> Writer;
         typedef rapidjson::GenericValue<rapidjson::UTF16<>> Value;
 
         MonitorUrl(const std::wstring &url, const std::wstring &playlistID, int flags, const std::wstring &groupName = std::wstring())
-            : URL(url), PlaylistID(playlistID), Flags(flags), GroupName(groupName) {
+            : URL(url), PlaylistID(playlistID), Flags(flags), GroupName(groupName), LastFullSync(0), LastCheck(0), LastChange(0), NextDue(0), Failures(0) {
 
         }
 
-        MonitorUrl(const Value &v) {
+        MonitorUrl(const Value &v) : Flags(0), LastFullSync(0), LastCheck(0), LastChange(0), NextDue(0), Failures(0) {
             if (v.IsObject()) {
                 URL = v[L"URL"].GetString();
                 Flags = v[L"Flags"].GetInt();
                 PlaylistID = v[L"PlaylistID"].GetString();
                 GroupName = v[L"GroupName"].GetString();
+                if (v.HasMember(L"LastFullSync") && v[L"LastFullSync"].IsInt64())
+                    LastFullSync = v[L"LastFullSync"].GetInt64();
+                if (v.HasMember(L"LastCheck") && v[L"LastCheck"].IsInt64())
+                    LastCheck = v[L"LastCheck"].GetInt64();
+                if (v.HasMember(L"LastChange") && v[L"LastChange"].IsInt64())
+                    LastChange = v[L"LastChange"].GetInt64();
+                if (v.HasMember(L"NextDue") && v[L"NextDue"].IsInt64())
+                    NextDue = v[L"NextDue"].GetInt64();
+                if (v.HasMember(L"Failures") && v[L"Failures"].IsInt())
+                    Failures = v[L"Failures"].GetInt();
             }
         }
 
@@ -54,6 +78,21 @@ public:
             writer.String(L"GroupName");
             writer.String(that.GroupName.c_str(), that.GroupName.size());
 
+            writer.String(L"LastFullSync");
+            writer.Int64(that.LastFullSync);
+
+            writer.String(L"LastCheck");
+            writer.Int64(that.LastCheck);
+
+            writer.String(L"LastChange");
+            writer.Int64(that.LastChange);
+
+            writer.String(L"NextDue");
+            writer.Int64(that.NextDue);
+
+            writer.String(L"Failures");
+            writer.Int(that.Failures);
+
             writer.EndObject();
             return writer;
         }
@@ -64,6 +103,7 @@ public:
         std::wstring ChannelName;
         std::wstring ReferenceName;
         std::unordered_set<std::wstring> Items;
+        std::unordered_map<std::wstring, std::wstring> ItemIds; // Video ID -> playlistItem ID, filled by syncs, not saved
         bool CanModify;
         std::wstring AIMPPlaylistId;
 
@@ -128,48 +168,112 @@ public:
         std::wstring Permalink;
         std::wstring Artwork;
         double Duration;
+        int64_t LastAccess; // As read from the cache file, the live value is kept by TrackInfoStore
+        int64_t Fetched;    // When the metadata above came from the API, 0 if unknown
 
         typedef rapidjson::Writer<rapidjson::FileWriteStream, rapidjson::UTF16<>> Writer;
         typedef rapidjson::GenericValue<rapidjson::UTF16<>> Value;
 
-        TrackInfo() : Duration(0) {}
+        TrackInfo() : Duration(0), LastAccess(std::time(nullptr)), Fetched(0) {}
         TrackInfo(const std::wstring &name, const std::wstring &id, const std::wstring &permalink, const std::wstring &artwork, double duration)
-            : Name(name), Id(id), Permalink(permalink), Artwork(artwork), Duration(duration) {
+            : Name(name), Id(id), Permalink(permalink), Artwork(artwork), Duration(duration), LastAccess(std::time(nullptr)), Fetched(LastAccess) {
 
         }
 
-        TrackInfo(const Value &v) {
+        TrackInfo(const Value &v) : Duration(0), LastAccess(std::time(nullptr)), Fetched(0) {
             if (v.IsObject()) {
                 Name      = v[L"N"].GetString();
                 Permalink = v[L"P"].GetString();
                 Artwork   = v[L"A"].GetString();
                 Duration  = v[L"D"].GetDouble();
+                if (v.HasMember(L"L") && v[L"L"].IsInt64())
+                    LastAccess = v[L"L"].GetInt64();
+                if (v.HasMember(L"F") && v[L"F"].IsInt64())
+                    Fetched = v[L"F"].GetInt64();
             }
         }
 
-        friend Writer &operator <<(Writer &writer, const TrackInfo &that) {
+        void Write(Writer &writer, int64_t lastAccess) const {
             writer.StartObject();
 
             writer.String(L"N");
-            writer.String(that.Name.c_str(), that.Name.size());
+            writer.String(Name.c_str(), Name.size());
 
             writer.String(L"P");
-            writer.String(that.Permalink.c_str(), that.Permalink.size());
+            writer.String(Permalink.c_str(), Permalink.size());
 
             writer.String(L"A");
-            writer.String(that.Artwork.c_str(), that.Artwork.size());
+            writer.String(Artwork.c_str(), Artwork.size());
 
             writer.String(L"D");
-            writer.Double(that.Duration);
+            writer.Double(Duration);
+
+            writer.String(L"L");
+            writer.Int64(lastAccess);
+
+            writer.String(L"F");
+            writer.Int64(Fetched);
 
             writer.EndObject();
+        }
+
+        friend Writer &operator <<(Writer &writer, const TrackInfo &that) {
+            that.Write(writer, that.LastAccess);
             return writer;
         }
     };
+    typedef std::shared_ptr<const TrackInfo> TrackInfoHandle;
+    class TrackInfoStore; // TrackInfoStore.h
+
+    // Typed copy of every plugin option. A snapshot is immutable once published,
+    // so any thread may read Config::Current() without locking.
+    struct Settings {
+        bool CheckOnStartup;
+        bool CheckEveryEnabled;
+        int CheckEveryHours;
+        bool MonitorUserPlaylists;
+        bool LimitUserStream;
+        int LimitUserStreamValue;
+        std::wstring YoutubeDLCmd;
+        int YoutubeDLTimeout;
+        std::wstring UserYTName;
+        int CacheMaxEntries;
+        int CacheMaxAgeDays;
+        bool PushEnabled;            // WebSub notifications for monitored channels
+        std::wstring PushCallbackUrl; // Public URL forwarded to PushPort
+        int PushPort;
+        int DurationBatches;         // Concurrent videos?id= requests when resolving durations
+        int ConcurrentSyncs;         // Monitored sources synced at once
+        int ValidateEveryHours;      // Check loaded playlists for unavailable videos, 0 = never
+        bool ValidateRemove;         // Remove unavailable videos instead of unchecking them
+        int RefreshAfterDays;        // Re-fetch titles, artwork and durations older than this, 0 = never
+
+        Settings();
+    };
+    typedef std::function<void(const Settings &oldSettings, const Settings &newSettings)> SettingsListener;
+
+    // Extended config is stored as separate files (shards) under Config\,
+    // SaveExtendedConfig() rewrites only the ones marked dirty.
+    enum Shard {
+        ShardNone          = 0,
+        ShardExclusions    = 1,
+        ShardMonitors      = 2,
+        ShardPlaylistIndex = 4,                      // Order of user playlists
+        ShardAllPlaylists  = 8 | ShardPlaylistIndex, // Index and every user playlist
+        ShardAll           = ShardExclusions | ShardMonitors | ShardAllPlaylists
+    };
 
     static bool Init(IAIMPCore *core);
     static void Deinit();
 
+    static const Settings &Current() { // Defaults before Init(), the last snapshot after Deinit()
+        const Settings *settings = m_settings.load(std::memory_order_acquire);
+        return settings ? *settings : m_defaultSettings;
+    }
+    static void LoadSettings();
+    static void SaveSettings(const Settings &settings);
+    static void OnSettingsChanged(SettingsListener listener);
+
     static void Delete(const std::wstring &name);
 
     static void SetString(const std::wstring &name, const std::wstring &value);
@@ -182,9 +286,26 @@ public:
 
     static inline std::wstring PluginConfigFolder() { return m_configFolder; }
 
+    static void MarkDirty(int shards) {
+        m_dirtyShards |= shards;
+        if ((shards & ShardAllPlaylists) == ShardAllPlaylists)
+            m_membershipVersion++;
+    }
+    static void MarkPlaylistDirty(const std::wstring &playlistId) { m_dirtyPlaylists.insert(playlistId); m_membershipVersion++; }
+
+    // Reverse of UserPlaylists[].Items: IDs of the user playlists holding videoId, nullptr if none.
+    // Rebuilt on the first call after a MarkPlaylistDirty() or MarkDirty(ShardAllPlaylists).
+    static const std::vector<std::wstring> *UserPlaylistsContaining(const std::wstring &videoId);
+
     static void SaveExtendedConfig();
     static void LoadExtendedConfig();
 
+    // Loads extended config and cache on a worker thread; onLoaded runs on the main thread afterwards.
+    // Code touching the containers below calls WaitUntilLoaded() first, which is a no-op once loaded.
+    static void BeginLoadExtendedConfig(std::function<void()> onLoaded = nullptr);
+    static inline bool IsLoaded() { return m_loaded.load(std::memory_order_acquire); }
+    static inline void WaitUntilLoaded() { if (!IsLoaded()) WaitForLoader(); }
+
     static void SaveCache();
     static void LoadCache();
     static bool ResolveTrackInfo(const std::wstring &id);
@@ -192,13 +313,37 @@ public:
     static std::unordered_set<std::wstring> TrackExclusions;
     static std::vector<MonitorUrl> MonitorUrls;
     static std::vector<Playlist> UserPlaylists;
-    static std::unordered_map<std::wstring, TrackInfo> TrackInfos;
+    static TrackInfoStore TrackInfos;
 
 private:
     Config();
     Config(const Config&);
     Config& operator=(const Config&);
 
+    static void PublishSettings(Settings *settings);
+
+    static bool SaveShards();
+    static bool LoadShards();
+    static void LoadLegacyConfig();
+    static void WaitForLoader();
+
     static std::wstring m_configFolder;
     static IAIMPConfig *m_config;
+
+    static std::atomic<const Settings *> m_settings;
+    static std::vector<std::unique_ptr<Settings>> m_settingsHistory; // Never freed while loaded, readers may still hold them
+    static const Settings m_defaultSettings;
+    static std::vector<SettingsListener> m_settingsListeners;
+
+    static int m_dirtyShards;
+    static std::atomic<unsigned> m_membershipVersion;
+    static unsigned m_membershipBuilt;
+    static std::unordered_map<std::wstring, std::vector<std::wstring>> m_membership;
+    static std::unordered_set<std::wstring> m_dirtyPlaylists;
+    static std::unordered_set<std::wstring> m_savedPlaylists; // Playlists having a shard on disk
+
+    static std::thread m_loader;
+    static std::mutex m_loadMutex;
+    static std::condition_variable m_loadCondition;
+    static std::atomic<bool> m_loaded;
 };
@@ -1,113 +1,211 @@
 #include "DurationResolver.h"
 #include "Tools.h"
+#include "TrackInfoStore.h"
 #include "AimpHTTP.h"
 #include "AIMPYouTube.h"
-#include <regex>
-#include <cmath>
-#include <unordered_map>
+#include "MainThread.h"
+#include "ResponseDecoder.h"
+#include "PlaylistIndex.h"
+#include "Timer.h"
+#include "SDK/apiFileManager.h"
 #include <memory>
-
-std::vector<DurationResolver::Item> DurationResolver::m_items;
-
-void DurationResolver::AddPlaylist(IAIMPPlaylist *pl) {
-    for (int i = 0, n = pl->GetItemCount(); i < n; ++i) {
-        IAIMPPlaylistItem *item = nullptr;
-        if (SUCCEEDED(pl->GetItem(i, IID_IAIMPPlaylistItem, reinterpret_cast<void **>(&item)))) {
-            IAIMPFileInfo *finfo = nullptr;
-            if (SUCCEEDED(item->GetValueAsObject(AIMP_PLAYLISTITEM_PROPID_FILEINFO, IID_IAIMPFileInfo, reinterpret_cast<void **>(&finfo)))) {
-                IAIMPString *custom = nullptr;
-                if (SUCCEEDED(finfo->GetValueAsObject(AIMP_FILEINFO_PROPID_FILENAME, IID_IAIMPString, reinterpret_cast<void **>(&custom)))) {
-                    if (auto ti = Tools::TrackInfo(custom)) {
-                        if (ti->Duration <= 0) {
-                            Item itm;
-                            itm.FileInfo = finfo;
-                            itm.Id = ti->Id;
-                            m_items.push_back(itm);
-                        } else {
-                            finfo->Release();
-                        }
-                    }
-                    custom->Release();
-                }
-                // finfo->Release();
+#include <algorithm>
+
+static const size_t BatchSize = 50; // Max IDs per videos?id= request
+static const int MaxBatches = 16;
+static const unsigned int MinRetryDelay = 30 * 1000;      // ms before resending batches that failed
+static const unsigned int MaxRetryDelay = 10 * 60 * 1000; // Doubled per failure up to this
+
+std::deque<std::wstring> DurationResolver::m_queue;
+std::unordered_map<std::wstring, std::vector<std::wstring>> DurationResolver::m_waiting;
+std::unordered_map<std::wstring, int64_t> DurationResolver::m_resolved;
+int DurationResolver::m_inFlight = 0;
+bool DurationResolver::m_applyPosted = false;
+ULONGLONG DurationResolver::m_started = 0;
+int DurationResolver::m_batches = 0;
+bool DurationResolver::m_retryPending = false;
+unsigned int DurationResolver::m_retryDelay = MinRetryDelay;
+
+void DurationResolver::Enqueue(const std::wstring &playlistId, const std::vector<std::wstring> &ids) {
+    if (playlistId.empty())
+        return;
+
+    bool cached = false;
+    for (const auto &id : ids) {
+        auto it = m_waiting.find(id);
+        if (it == m_waiting.end()) {
+            it = m_waiting.emplace(id, std::vector<std::wstring>()).first;
+
+            // Resolved meanwhile for another playlist, only the row needs it
+            auto ti = Tools::TrackInfo(id);
+            if (ti && ti->Duration > 0) {
+                m_resolved[id] = (int64_t)ti->Duration;
+                cached = true;
+            } else {
+                m_queue.push_back(id);
             }
-            item->Release();
         }
+        // Already queued or in flight: the pending request covers this playlist too
+        if (std::find(it->second.begin(), it->second.end(), playlistId) == it->second.end())
+            it->second.push_back(playlistId);
+    }
+
+    if (cached && !m_applyPosted) {
+        m_applyPosted = MainThread::Post(Apply);
     }
 }
 
 void DurationResolver::Resolve() {
+    if (m_queue.empty() || m_retryPending)
+        return;
+
+    if (m_batches == 0)
+        m_started = GetTickCount64();
+
+    const int maxInFlight = (std::max)(1, (std::min)(MaxBatches, Config::Current().DurationBatches));
+    while (m_inFlight < maxInFlight && !m_queue.empty()) {
+        if (!SendBatch()) {
+            RetryLater();
+            break;
+        }
+    }
+}
+
+bool DurationResolver::SendBatch() {
+    auto ids = std::make_shared<std::vector<std::wstring>>();
     std::wstring allIds;
-    auto map = std::make_shared<std::unordered_map<std::wstring, IAIMPFileInfo *>>();
-    int n = (std::min)(std::size_t(50), m_items.size());
-    for (int i = 0; i < n; ++i) {
-        allIds += m_items[i].Id + L",";
-        (*map)[m_items[i].Id] = m_items[i].FileInfo;
+    while (ids->size() < BatchSize && !m_queue.empty()) {
+        if (!allIds.empty())
+            allIds += L',';
+        allIds += m_queue.front();
+        ids->push_back(std::move(m_queue.front()));
+        m_queue.pop_front();
     }
-    m_items.erase(m_items.begin(), m_items.begin() + n);
-
-    if (allIds.size() > 1) {
-        allIds.resize(allIds.size() - 1); // Remove trailing comma
-
-        std::wstring reqUrl(L"https://www.googleapis.com/youtube/v3/videos?part=contentDetails&hl=" + Plugin::instance()->Lang(L"YouTube\\YouTubeLang") + L"&id=" + allIds);
-        reqUrl += L"&key=" TEXT(APP_KEY);
-        if (Plugin::instance()->isConnected())
-            reqUrl += L"\r\nAuthorization: Bearer " + Plugin::instance()->getAccessToken();
-
-        AimpHTTP::Get(reqUrl, [map](unsigned char *data, int size) {
-            rapidjson::Document d;
-            d.Parse(reinterpret_cast<const char *>(data));
-
-            if (d.IsObject() && d.HasMember("items")) {
-                rapidjson::Value &a = d["items"];
-                if (a.IsArray()) {
-                    for (auto x = a.Begin(), e = a.End(); x != e; x++) {
-                        const rapidjson::Value *px = &(*x);
-                        if (!px->IsObject() || !px->HasMember("contentDetails"))
-                            continue;
-
-                        const rapidjson::Value &contentDetails = (*px)["contentDetails"];
-
-                        int videoDuration = 0;
-                        if (contentDetails.IsObject() && contentDetails.HasMember("duration")) {
-                            std::wstring duration = Tools::ToWString(contentDetails["duration"]);
-
-                            std::wregex re(L"PT(?:([0-9]+)H)?(?:([0-9]+)M)?(?:([0-9]+)S)?");
-                            std::wsmatch match;
-                            if (std::regex_match(duration, match, re)) {
-                                auto h = match[1].matched ? std::stoll(match[1].str()) : 0;
-                                auto m = match[2].matched ? std::stoll(match[2].str()) : 0;
-                                auto s = match[3].matched ? std::stoll(match[3].str()) : 0;
-                                videoDuration = h * 3600 + m * 60 + s;
-
-                                std::wstring id = Tools::ToWString((*px)["id"].GetString());
-                                if (auto finfo = (*map)[id]) {
-                                    finfo->SetValueAsFloat(AIMP_FILEINFO_PROPID_DURATION, videoDuration);
-
-                                    // It was not released previously on purpose, release it now
-                                    finfo->Release();
-                                    (*map)[id] = nullptr;
-                                }
-
-                                if (auto ti = Tools::TrackInfo(id)) {
-                                    ti->Duration = videoDuration;
-                                }
-                            }
-                        }
-                    }
-                }
-            }
 
-            for (const auto &x : (*map)) {
-                if (x.second)
-                    x.second->Release();
+    std::wstring reqUrl(L"https://www.googleapis.com/youtube/v3/videos?part=contentDetails&fields=items(id%2CcontentDetails%2Fduration)&hl=" + Plugin::instance()->Lang(L"YouTube\\YouTubeLang") + L"&id=" + allIds);
+    reqUrl += L"&key=" TEXT(APP_KEY);
+    if (Plugin::instance()->isConnected())
+        reqUrl += L"\r\nAuthorization: Bearer " + Plugin::instance()->getAccessToken();
+
+    m_inFlight++;
+    m_batches++;
+    bool started = AimpHTTP::Get(reqUrl, [ids](unsigned char *data, int size) {
+        // Decode here, only the results go to the main thread
+        auto results = std::make_shared<Results>();
+        ResponseDecoder::Response r;
+        const bool failed = AimpHTTP::Failed() || !ResponseDecoder::Decode(reinterpret_cast<char *>(data), r) || !r.Valid || r.Error;
+        if (!failed) {
+            results->reserve(r.Items.size());
+            for (auto &x : r.Items) {
+                if (x.Duration >= 0)
+                    results->emplace_back(std::move(x.Id), x.Duration);
             }
+        }
+
+        MainThread::Post([ids, results, failed] {
+            OnBatch(*ids, *results, failed);
+        });
+    });
+
+    if (!started) {
+        // Still in m_waiting, they go out again after RetryLater()
+        m_inFlight--;
+        m_batches--;
+        m_queue.insert(m_queue.begin(), ids->begin(), ids->end());
+    }
+    return started;
+}
+
+void DurationResolver::OnBatch(const std::vector<std::wstring> &ids, const Results &results, bool failed) {
+    m_inFlight--;
+
+    if (failed) {
+        // No connection, quota or server error: nothing else would enqueue them again
+        m_queue.insert(m_queue.begin(), ids.begin(), ids.end());
+        RetryLater();
+        return;
+    }
+    m_retryDelay = MinRetryDelay;
+
+    // IDs missing from a valid response (deleted, private) are dropped
+    for (const auto &id : ids) {
+        m_resolved.emplace(id, 0);
+    }
+    for (const auto &x : results) {
+        m_resolved[x.first] = x.second;
+    }
+
+    // Batches finishing close together share one Apply()
+    if (!m_applyPosted) {
+        m_applyPosted = MainThread::Post(Apply);
+    }
+
+    Resolve();
+}
+
+void DurationResolver::RetryLater() {
+    if (m_retryPending)
+        return;
+
+    DebugW(L"DurationResolver: %u videos waiting, retrying in %u s\n", (unsigned)m_waiting.size(), m_retryDelay / 1000);
+    m_retryPending = true;
+    Timer::SingleShot(m_retryDelay, [] {
+        m_retryPending = false;
+        Resolve();
+    });
+    m_retryDelay = (std::min)(m_retryDelay * 2, MaxRetryDelay);
+}
 
-            Config::SaveCache();
+void DurationResolver::Apply() {
+    m_applyPosted = false;
 
-            if (m_items.size() > 0) {
-                Resolve();
+    int updated = 0;
+    std::unordered_map<std::wstring, std::unordered_map<std::wstring, int64_t>> byPlaylist;
+    for (const auto &x : m_resolved) {
+        auto it = m_waiting.find(x.first);
+        if (it == m_waiting.end())
+            continue;
+
+        const int64_t duration = x.second;
+        if (duration > 0) {
+            for (const auto &playlistId : it->second) {
+                byPlaylist[playlistId][x.first] = duration;
             }
-        });
+            Config::TrackInfos.Update(x.first, [duration](Config::TrackInfo &ti) {
+                ti.Duration = duration;
+            });
+            updated++;
+        }
+        m_waiting.erase(it);
+    }
+    m_resolved.clear();
+
+    // Rows come from PlaylistIndex, one BeginUpdate/EndUpdate per playlist
+    for (const auto &pl : byPlaylist) {
+        IAIMPPlaylist *playlist = Plugin::instance()->GetPlaylistById(pl.first);
+        if (!playlist)
+            continue; // Closed meanwhile, the cache still got the durations
+
+        playlist->BeginUpdate();
+        for (const auto &x : pl.second) {
+            const double duration = (double)x.second;
+            PlaylistIndex::ForRows(playlist, x.first, [duration](IAIMPPlaylistItem *item) {
+                IAIMPFileInfo *finfo = nullptr;
+                if (SUCCEEDED(item->GetValueAsObject(AIMP_PLAYLISTITEM_PROPID_FILEINFO, IID_IAIMPFileInfo, reinterpret_cast<void **>(&finfo)))) {
+                    finfo->SetValueAsFloat(AIMP_FILEINFO_PROPID_DURATION, duration);
+                    finfo->Release();
+                }
+            });
+        }
+        playlist->EndUpdate();
+        playlist->Release();
+    }
+
+    if (updated > 0)
+        Config::SaveCache();
+
+    if (m_batches > 0 && m_inFlight == 0 && m_queue.empty()) {
+        DebugW(L"DurationResolver: %d batches in %llu ms\n", m_batches, GetTickCount64() - m_started);
+        m_batches = 0;
     }
 }
@@ -1,20 +1,47 @@
 #pragma once
 
+#include <deque>
 #include <vector>
-#include "SDK/apiPlaylists.h"
-#include "SDK/apiFileManager.h"
+#include <string>
+#include <unordered_map>
 
+// Fills in durations for items loaded without one. The loader hands over the
+// video IDs it inserted, nothing else is looked at. IDs are queued once no
+// matter how many playlists hold them and sent 50 per videos?id= request, with
+// up to Settings::DurationBatches requests in flight. Responses are decoded on
+// the network thread and applied on the main thread, several batches at a time,
+// with the rows looked up in PlaylistIndex. Batches that fail or get an error
+// back are queued again and resent with a backoff, only IDs missing from a
+// valid response count as unavailable.
+//
+// Everything except the HTTP callbacks runs on the main thread.
 class DurationResolver {
 public:
-    
-    static void AddPlaylist(IAIMPPlaylist *pl);
+    static void Enqueue(const std::wstring &playlistId, const std::vector<std::wstring> &ids); // AIMP playlist ID, video IDs in it
 
-    static void Resolve();
+    static void Resolve(); // Tops up the requests in flight, no-op while the queue is empty
 
-    struct Item {
-        IAIMPFileInfo *FileInfo;
-        std::wstring Id;
-    };
-    static std::vector<Item> m_items;
-};
+    static inline size_t Pending() { return m_waiting.size(); }
+
+private:
+    typedef std::vector<std::pair<std::wstring, int64_t>> Results;
+
+    static bool SendBatch(); // False if the request couldn't be started
+    static void OnBatch(const std::vector<std::wstring> &ids, const Results &results, bool failed);
+    static void RetryLater(); // Failed batches are back in the queue, resent with a backoff
+    static void Apply();
 
+    static std::deque<std::wstring> m_queue; // Waiting for a batch
+    static std::unordered_map<std::wstring, std::vector<std::wstring>> m_waiting; // Queued or in flight, with the playlists holding them
+    static std::unordered_map<std::wstring, int64_t> m_resolved; // Applied on the next Apply(), 0 if unavailable
+    static int m_inFlight;
+    static bool m_applyPosted;
+    static ULONGLONG m_started;
+    static int m_batches;
+    static bool m_retryPending;
+    static unsigned int m_retryDelay;
+
+    DurationResolver();
+    DurationResolver(const DurationResolver &);
+    DurationResolver &operator=(const DurationResolver &);
+};
@@ -28,11 +28,16 @@ extern HINSTANCE g_hInst;
 
 #define WM_SUBCLASSINIT WM_USER + 4
 
+std::vector<Config::TrackInfoHandle> ExclusionsDialog::m_items;
+
 void ExclusionsDialog::Show(HWND parent) {
+    Config::WaitUntilLoaded();
+
     if (!parent)
         parent = Plugin::instance()->GetMainWindowHandle();
 
     DialogBox(g_hInst, MAKEINTRESOURCE(IDD_EXCLUSIONS), parent, DlgProc);
+    m_items.clear();
 }
 
 BOOL CALLBACK ExclusionsDialog::DlgProc(HWND hwnd, UINT Msg, WPARAM wParam, LPARAM lParam) {
@@ -76,7 +81,7 @@ BOOL CALLBACK ExclusionsDialog::DlgProc(HWND hwnd, UINT Msg, WPARAM wParam, LPAR
                                 selectedItem.iItem = i;
                                 ListView_GetItem(lv, (LVITEM *)&selectedItem);
 
-                                if (auto ti = reinterpret_cast<Config::TrackInfo *>(selectedItem.lParam)) {
+                                if (auto ti = reinterpret_cast<const Config::TrackInfo *>(selectedItem.lParam)) {
                                     switch (result) {
                                         case 0x57d001: // remove from exclusions
                                             Config::TrackExclusions.erase(ti->Id);
@@ -101,6 +106,7 @@ BOOL CALLBACK ExclusionsDialog::DlgProc(HWND hwnd, UINT Msg, WPARAM wParam, LPAR
                                 }
                                 i = ListView_GetNextItem(lv, i, LVNI_SELECTED);
                             }
+                            Config::MarkDirty(Config::ShardExclusions);
                             Config::SaveExtendedConfig();
                         }
                     } break;
@@ -155,7 +161,8 @@ BOOL CALLBACK ExclusionsDialog::DlgProc(HWND hwnd, UINT Msg, WPARAM wParam, LPAR
                         lvi.iItem = i;
                         lvi.iSubItem = 0;
                         lvi.iImage = 0;
-                        lvi.lParam = reinterpret_cast<LPARAM>(ti);
+                        lvi.lParam = reinterpret_cast<LPARAM>(ti.get());
+                        m_items.push_back(ti);
                         ListView_InsertItem(lv, &lvi);
 
                         unsigned int hours = floor(ti->Duration / 3600.0);
@@ -201,12 +208,13 @@ LRESULT CALLBACK ExclusionsDialog::ListViewProc(HWND hWnd, UINT uMsg, WPARAM wPa
                             selectedItem.iItem = i;
                             ListView_GetItem(hWnd, (LVITEM *)&selectedItem);
 
-                            if (auto ti = reinterpret_cast<Config::TrackInfo *>(selectedItem.lParam)) {
+                            if (auto ti = reinterpret_cast<const Config::TrackInfo *>(selectedItem.lParam)) {
                                 Config::TrackExclusions.erase(ti->Id);
                                 ListView_DeleteItem(hWnd, i--);
                             }
                             i = ListView_GetNextItem(hWnd, i, LVNI_SELECTED);
                         }
+                        Config::MarkDirty(Config::ShardExclusions);
                         Config::SaveExtendedConfig();
                     }
                 } break;
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <windows.h>
+#include <vector>
+#include "Config.h"
 
 class ExclusionsDialog {
 public:
@@ -13,4 +15,6 @@ private:
 
     static BOOL CALLBACK DlgProc(HWND hwnd, UINT Msg, WPARAM wParam, LPARAM lParam);
     static LRESULT CALLBACK ListViewProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam, UINT_PTR uIdSubclass, DWORD_PTR dwRefData);
+
+    static std::vector<Config::TrackInfoHandle> m_items; // Keeps the infos referenced by list view items alive
 };
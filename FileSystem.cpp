@@ -95,7 +95,7 @@ HRESULT WINAPI FileSystem::GetValueAsObject(int PropertyID, REFIID IID, void **V
 
 HRESULT WINAPI FileSystem::CreateStream(IAIMPString *FileName, IAIMPStream **Stream) {
     HRESULT ret = E_FAIL;
-    if (Config::TrackInfo *ti = Tools::TrackInfo(FileName)) {
+    if (auto ti = Tools::TrackInfo(FileName)) {
         EventListener *listener = new EventListener();
         *Stream = listener->m_stream;
 
@@ -111,7 +111,7 @@ HRESULT WINAPI FileSystem::CreateStream(IAIMPString *FileName, IAIMPStream **Str
 }
 
 HRESULT WINAPI FileSystem::Process(IAIMPString *FileName) {
-    if (Config::TrackInfo *ti = Tools::TrackInfo(FileName)) {
+    if (auto ti = Tools::TrackInfo(FileName)) {
         ShellExecute(Plugin::instance()->GetMainWindowHandle(), L"open", ti->Permalink.c_str(), NULL, NULL, SW_SHOWNORMAL);
         return S_OK;
     }
@@ -123,7 +123,7 @@ HRESULT WINAPI FileSystem::CopyToClipboard(IAIMPObjectList *Files) {
     for (int i = 0, n = Files->GetCount(); i < n; ++i) {
         IAIMPString *str = nullptr;
         Files->GetObject(i, IID_IAIMPString, reinterpret_cast<void **>(&str));
-        if (Config::TrackInfo *ti = Tools::TrackInfo(str)) {
+        if (auto ti = Tools::TrackInfo(str)) {
             text += Tools::ToString(ti->Permalink) + "\r\n";
         }
         str->Release();
@@ -0,0 +1,67 @@
+#include "MainThread.h"
+
+extern HINSTANCE g_hInst;
+
+static const UINT WM_MAINTHREAD_CALL = WM_APP + 1;
+static const wchar_t *WindowClass = L"AIMPYouTubeMainThread";
+
+HWND MainThread::m_window = NULL;
+DWORD MainThread::m_threadId = 0;
+
+bool MainThread::Init() {
+    WNDCLASSEX wc = { sizeof(WNDCLASSEX) };
+    wc.lpfnWndProc = WndProc;
+    wc.hInstance = g_hInst;
+    wc.lpszClassName = WindowClass;
+    RegisterClassEx(&wc);
+
+    m_threadId = GetCurrentThreadId();
+    m_window = CreateWindowEx(0, WindowClass, NULL, 0, 0, 0, 0, 0, HWND_MESSAGE, NULL, g_hInst, NULL);
+    return m_window != NULL;
+}
+
+void MainThread::Deinit() {
+    if (!m_window)
+        return;
+
+    // Drop whatever is still queued, nobody is left to handle it
+    MSG msg;
+    while (PeekMessage(&msg, m_window, WM_MAINTHREAD_CALL, WM_MAINTHREAD_CALL, PM_REMOVE)) {
+        delete reinterpret_cast<Callback *>(msg.lParam);
+    }
+
+    DestroyWindow(m_window);
+    UnregisterClass(WindowClass, g_hInst);
+    m_window = NULL;
+}
+
+bool MainThread::Post(Callback func) {
+    if (!m_window || !func)
+        return false;
+
+    Callback *call = new Callback(std::move(func));
+    if (!PostMessage(m_window, WM_MAINTHREAD_CALL, 0, reinterpret_cast<LPARAM>(call))) {
+        delete call;
+        return false;
+    }
+    return true;
+}
+
+void MainThread::Run(Callback func) {
+    if (IsCurrent()) {
+        if (func)
+            func();
+    } else {
+        Post(std::move(func));
+    }
+}
+
+LRESULT CALLBACK MainThread::WndProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam) {
+    if (uMsg == WM_MAINTHREAD_CALL) {
+        Callback *call = reinterpret_cast<Callback *>(lParam);
+        (*call)();
+        delete call;
+        return 0;
+    }
+    return DefWindowProc(hWnd, uMsg, wParam, lParam);
+}
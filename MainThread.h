@@ -0,0 +1,27 @@
+#pragma once
+
+#include <windows.h>
+#include <functional>
+
+// Runs callbacks on the thread that called Init() (AIMP's UI thread).
+// Post() may be called from any thread.
+class MainThread {
+    typedef std::function<void()> Callback;
+public:
+    static bool Init();
+    static void Deinit();
+
+    static bool Post(Callback func);
+    static void Run(Callback func); // Right away when already on the main thread, posted otherwise
+    static inline bool IsCurrent() { return GetCurrentThreadId() == m_threadId; }
+
+private:
+    static LRESULT CALLBACK WndProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam);
+
+    static HWND m_window;
+    static DWORD m_threadId;
+
+    MainThread();
+    MainThread(const MainThread &);
+    MainThread &operator=(const MainThread &);
+};
@@ -5,6 +5,7 @@
 #include "SDK/apiPlayer.h"
 #include "AIMPYouTube.h"
 #include "YouTubeAPI.h"
+#include "PlaylistIndex.h"
 
 MessageHook::MessageHook(Plugin *pl) : m_plugin(pl) {
     
@@ -22,18 +23,15 @@ void WINAPI MessageHook::CoreMessage(DWORD AMessage, int AParam1, void *AParam2,
             std::wstring id = Tools::TrackIdFromUrl(url->GetData());
             url->Release();
             if (!id.empty()) {
+                Config::WaitUntilLoaded();
                 for (auto &x : Config::UserPlaylists) {
                     for (auto &xx : x.Items) {
                         if (xx == id) {
                             x.Items.erase(id);
+                            Config::MarkPlaylistDirty(x.ID);
 
                             if (IAIMPPlaylist *playlist = Plugin::instance()->GetPlaylistById(x.AIMPPlaylistId)) {
-                                Plugin::instance()->ForEveryItem(playlist, [&id](IAIMPPlaylistItem *, IAIMPFileInfo *, const std::wstring &itemid) {
-                                    if (!itemid.empty() && itemid == id) {
-                                        return Plugin::FLAG_DELETE_ITEM | Plugin::FLAG_STOP_LOOP;
-                                    }
-                                    return 0;
-                                });
+                                PlaylistIndex::Delete(playlist, id);
                                 playlist->Release();
                             }
                             break;
@@ -41,9 +39,12 @@ void WINAPI MessageHook::CoreMessage(DWORD AMessage, int AParam1, void *AParam2,
                     }
                 }
                 Config::TrackExclusions.insert(id);
+                Config::MarkDirty(Config::ShardExclusions);
                 Config::SaveExtendedConfig();
                 IAIMPPlaylist *parent = nullptr;
                 if (SUCCEEDED(currentTrack->GetValueAsObject(AIMP_PLAYLISTITEM_PROPID_PLAYLIST, IID_IAIMPPlaylist, reinterpret_cast<void **>(&parent)))) {
+                    PlaylistIndex::Mutation mutation(parent);
+                    PlaylistIndex::Removed(parent, currentTrack, id);
                     parent->Delete(currentTrack);
                     parent->Release();
                 }
@@ -72,6 +73,7 @@ void WINAPI MessageHook::CoreMessage(DWORD AMessage, int AParam1, void *AParam2,
             return deleted.find(Tools::TrackIdFromUrl(element.URL)) != deleted.end();
         }), Config::MonitorUrls.end());
 
+        Config::MarkDirty(Config::ShardMonitors);
         Config::SaveExtendedConfig();
     }
 
@@ -0,0 +1,248 @@
+#include "MetadataRefresher.h"
+
+#include "AIMPYouTube.h"
+#include "AimpHTTP.h"
+#include "AIMPString.h"
+#include "Config.h"
+#include "MainThread.h"
+#include "MonitorEngine.h"
+#include "ResponseDecoder.h"
+#include "PlaylistIndex.h"
+#include "Timer.h"
+#include "Tools.h"
+#include "TrackInfoStore.h"
+#include "SDK/apiPlaylists.h"
+#include "SDK/apiFileManager.h"
+#include <ctime>
+#include <memory>
+#include <algorithm>
+
+static const unsigned int TickInterval = 10 * 60 * 1000; // ms between two due checks
+static const int64_t      RunInterval  = 6 * 3600;       // s between two runs
+static const size_t       BatchSize    = 50;             // Max IDs per videos?id= request
+static const size_t       MaxPerRun    = 1000;           // Entries refreshed per run, 20 quota units
+
+UINT_PTR MetadataRefresher::m_timer = 0;
+bool MetadataRefresher::m_running = false;
+int MetadataRefresher::m_generation = 0;
+ULONGLONG MetadataRefresher::m_started = 0;
+std::vector<std::wstring> MetadataRefresher::m_ids;
+size_t MetadataRefresher::m_next = 0;
+int MetadataRefresher::m_requests = 0;
+int64_t MetadataRefresher::m_bytes = 0;
+bool MetadataRefresher::m_failed = false;
+std::unordered_map<std::wstring, int> MetadataRefresher::m_changed;
+
+void MetadataRefresher::Start() {
+    if (m_timer)
+        return;
+
+    m_timer = Timer::Schedule(TickInterval, Tick);
+}
+
+void MetadataRefresher::Stop() {
+    if (m_timer) {
+        Timer::Cancel(m_timer);
+        m_timer = 0;
+    }
+
+    m_generation++;
+    m_running = false;
+    m_ids.clear();
+    m_changed.clear();
+}
+
+void MetadataRefresher::Tick() {
+    if (m_running || Config::Current().RefreshAfterDays <= 0 || !Config::IsLoaded())
+        return;
+
+    if (std::time(nullptr) >= Config::GetInt64(L"LastRefresh") + RunInterval)
+        Run();
+}
+
+void MetadataRefresher::Run() {
+    const int days = Config::Current().RefreshAfterDays;
+    if (m_running || days <= 0 || !Config::IsLoaded())
+        return;
+
+    const int64_t staleBefore = std::time(nullptr) - int64_t(days) * 86400;
+
+    std::vector<std::pair<Config::TrackInfoHandle, int64_t>> infos;
+    Config::TrackInfos.Snapshot(infos);
+
+    std::vector<std::pair<int64_t, std::wstring>> stale;
+    for (const auto &x : infos) {
+        if (x.first->Fetched < staleBefore)
+            stale.emplace_back(x.first->Fetched, x.first->Id);
+    }
+    infos.clear();
+
+    if (stale.size() > MaxPerRun) {
+        std::partial_sort(stale.begin(), stale.begin() + MaxPerRun, stale.end());
+        stale.resize(MaxPerRun);
+    }
+
+    if (stale.empty()) {
+        Config::SetInt64(L"LastRefresh", std::time(nullptr));
+        return;
+    }
+
+    m_ids.clear();
+    m_ids.reserve(stale.size());
+    for (auto &x : stale) {
+        m_ids.push_back(std::move(x.second));
+    }
+
+    m_running = true;
+    m_started = GetTickCount64();
+    m_next = 0;
+    m_requests = 0;
+    m_bytes = 0;
+    m_failed = false;
+    m_changed.clear();
+    SendBatch();
+}
+
+void MetadataRefresher::SendBatch() {
+    if (m_next >= m_ids.size()) {
+        Finish();
+        return;
+    }
+
+    auto ids = std::make_shared<std::vector<std::wstring>>();
+    std::wstring allIds;
+    for (; m_next < m_ids.size() && ids->size() < BatchSize; ++m_next) {
+        if (!allIds.empty())
+            allIds += L',';
+        allIds += m_ids[m_next];
+        ids->push_back(m_ids[m_next]);
+    }
+
+    std::wstring reqUrl(L"https://www.googleapis.com/youtube/v3/videos?part=contentDetails%2Csnippet&hl=" + Plugin::instance()->Lang(L"YouTube\\YouTubeLang") +
+                        L"&fields=items(id%2Csnippet(title%2Cthumbnails%2Fhigh%2Furl)%2CcontentDetails%2Fduration)&id=" + allIds);
+    reqUrl += L"&key=" TEXT(APP_KEY);
+    if (Plugin::instance()->isConnected())
+        reqUrl += L"\r\nAuthorization: Bearer " + Plugin::instance()->getAccessToken();
+
+    m_requests++;
+    const int generation = m_generation;
+    bool started = AimpHTTP::Get(reqUrl, [ids, generation](unsigned char *data, int size) {
+        auto r = std::make_shared<ResponseDecoder::Response>();
+        const bool failed = AimpHTTP::Failed() || !ResponseDecoder::Decode(reinterpret_cast<char *>(data), *r) || !r->Valid || r->Error;
+
+        MainThread::Post([ids, generation, r, size, failed] {
+            if (generation != m_generation)
+                return;
+
+            m_bytes += size;
+            if (failed) {
+                // Offline or out of quota, the rest of the run would fail too. The records
+                // stay as old as they are, the next tick tries again.
+                m_failed = true;
+                Finish();
+                return;
+            }
+
+            const int64_t now = std::time(nullptr);
+            for (const auto &x : r->Items) {
+                if (!x.HasTitle || x.Title == L"Deleted video" || x.Title == L"Private video")
+                    continue; // Left to PlaylistValidator
+
+                int changes = 0;
+                Config::TrackInfos.Update(x.Id, [&](Config::TrackInfo &ti) {
+                    if (ti.Name != x.Title) {
+                        ti.Name = x.Title;
+                        changes |= ChangeTitle;
+                    }
+                    if (!x.Artwork.empty() && ti.Artwork != x.Artwork) {
+                        ti.Artwork = x.Artwork;
+                        changes |= ChangeArtwork;
+                    }
+                    if (x.Duration > 0 && (int64_t)ti.Duration != x.Duration) {
+                        ti.Duration = (double)x.Duration;
+                        changes |= ChangeDuration;
+                    }
+                    ti.Fetched = now;
+                });
+                if (changes)
+                    m_changed[x.Id] |= changes;
+            }
+
+            // Missing from the response (deleted, private) wait a full period too, instead of
+            // heading the oldest-first list every run
+            for (const auto &id : *ids) {
+                Config::TrackInfos.Update(id, [now](Config::TrackInfo &ti) {
+                    if (ti.Fetched < now)
+                        ti.Fetched = now;
+                });
+            }
+            SendBatch();
+        });
+    });
+
+    if (!started) {
+        m_failed = true;
+        Finish();
+    }
+}
+
+void MetadataRefresher::Finish() {
+    int rowsTouched = 0;
+
+    // Artwork isn't stored in the rows, ArtworkProvider reads it from the cache
+    bool rowsChanged = false;
+    for (const auto &x : m_changed) {
+        if (x.second & (ChangeTitle | ChangeDuration)) {
+            rowsChanged = true;
+            break;
+        }
+    }
+
+    if (rowsChanged) {
+        std::vector<IAIMPPlaylist *> playlists;
+        Plugin::instance()->ForAllPlaylists([&playlists](IAIMPPlaylist *pl, const std::wstring &) {
+            playlists.push_back(pl);
+        });
+
+        for (IAIMPPlaylist *pl : playlists) {
+            if (!MonitorEngine::IsSyncing(Plugin::instance()->PlaylistId(pl))) {
+                pl->BeginUpdate();
+                for (const auto &x : m_changed) {
+                    const int changes = x.second;
+                    if (!(changes & (ChangeTitle | ChangeDuration)))
+                        continue;
+
+                    auto ti = Config::TrackInfos.Peek(x.first);
+                    if (!ti)
+                        continue;
+
+                    PlaylistIndex::ForRows(pl, x.first, [&](IAIMPPlaylistItem *item) {
+                        IAIMPFileInfo *finfo = nullptr;
+                        if (FAILED(item->GetValueAsObject(AIMP_PLAYLISTITEM_PROPID_FILEINFO, IID_IAIMPFileInfo, reinterpret_cast<void **>(&finfo))))
+                            return;
+
+                        if (changes & ChangeTitle)
+                            finfo->SetValueAsObject(AIMP_FILEINFO_PROPID_TITLE, AIMPString(ti->Name));
+                        if (changes & ChangeDuration)
+                            finfo->SetValueAsFloat(AIMP_FILEINFO_PROPID_DURATION, ti->Duration);
+                        finfo->Release();
+                        rowsTouched++;
+                    });
+                }
+                pl->EndUpdate();
+            }
+            pl->Release();
+        }
+    }
+
+    Config::SaveCache();
+    if (!m_failed)
+        Config::SetInt64(L"LastRefresh", std::time(nullptr));
+
+    DebugW(L"MetadataRefresher: %s%u records checked in %llu ms, %u changed, %d rows touched, %lld bytes in %d requests\n",
+           m_failed ? L"stopped by a failed request, " : L"", (unsigned)m_next, GetTickCount64() - m_started, (unsigned)m_changed.size(), rowsTouched, m_bytes, m_requests);
+
+    m_running = false;
+    m_ids.clear();
+    m_changed.clear();
+}
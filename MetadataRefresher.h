@@ -0,0 +1,48 @@
+#pragma once
+
+#include <windows.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+// Re-fetches titles, artwork and durations of Config::TrackInfos entries older
+// than Settings::RefreshAfterDays, oldest first, 50 per videos?id= request and
+// at most MaxPerRun entries per run. Only entries whose data actually changed
+// are rewritten, and only the changed properties of the playlist rows holding
+// them are set, one BeginUpdate/EndUpdate per playlist after the run.
+class MetadataRefresher {
+public:
+    static void Start();
+    static void Stop();
+
+    static void Run(); // Starts a run right away, no-op while one is going
+
+    static inline bool IsRunning() { return m_running; }
+
+private:
+    enum Change {
+        ChangeTitle    = 1,
+        ChangeArtwork  = 2,
+        ChangeDuration = 4
+    };
+
+    static void Tick();
+    static void SendBatch();
+    static void Finish();
+
+    static UINT_PTR m_timer;
+    static bool m_running;
+    static int m_generation; // Responses from a stopped run are dropped
+    static ULONGLONG m_started;
+
+    static std::vector<std::wstring> m_ids;
+    static size_t m_next;
+    static int m_requests;
+    static int64_t m_bytes;
+    static bool m_failed; // A request failed, the run stopped there
+    static std::unordered_map<std::wstring, int> m_changed; // Video ID -> Change flags
+
+    MetadataRefresher();
+    MetadataRefresher(const MetadataRefresher &);
+    MetadataRefresher &operator=(const MetadataRefresher &);
+};
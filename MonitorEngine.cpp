@@ -0,0 +1,199 @@
+#include "MonitorEngine.h"
+
+#include "AIMPYouTube.h"
+#include "YouTubeAPI.h"
+#include "Tools.h"
+#include <ctime>
+#include <random>
+#include <algorithm>
+
+static const int64_t FullSyncInterval   = 24 * 60 * 60;     // s between two full syncs of a newest-first source
+static const int64_t MaxSlowdown        = 8;                // Quiet sources are checked at most this many times less often
+static const int64_t MaxBackoff         = 24 * 60 * 60;     // s, cap for failing sources
+static const int     JitterPercent      = 10;
+
+std::deque<Config::MonitorUrl> MonitorEngine::m_pending;
+std::unordered_set<std::wstring> MonitorEngine::m_busyPlaylists;
+int MonitorEngine::m_running = 0;
+int MonitorEngine::m_generation = 0;
+int MonitorEngine::m_synced = 0;
+bool MonitorEngine::m_sweepRequested = false;
+bool MonitorEngine::m_sweepDueOnly = true;
+bool MonitorEngine::m_pumping = false;
+ULONGLONG MonitorEngine::m_sweepStart = 0;
+
+void MonitorEngine::StartSweep(bool dueOnly) {
+    if (IsRunning()) {
+        // Something changed while syncing, go again once this sweep is done
+        m_sweepDueOnly = m_sweepRequested ? (m_sweepDueOnly && dueOnly) : dueOnly;
+        m_sweepRequested = true;
+        return;
+    }
+
+    const int64_t now = std::time(nullptr);
+    m_pending.clear();
+    for (const auto &x : Config::MonitorUrls) {
+        if (!dueOnly || x.NextDue <= now)
+            m_pending.push_back(x);
+    }
+    if (m_pending.empty())
+        return;
+
+    m_synced = 0;
+    m_sweepRequested = false;
+    m_sweepStart = GetTickCount64();
+    Pump();
+}
+
+void MonitorEngine::SyncPlaylist(const std::wstring &playlistId) {
+    const bool idle = !IsRunning();
+    for (const auto &x : Config::MonitorUrls) {
+        if (x.PlaylistID != playlistId)
+            continue;
+
+        auto same = [&x](const Config::MonitorUrl &p) -> bool { return p.URL == x.URL && p.PlaylistID == x.PlaylistID; };
+        if (std::find_if(m_pending.begin(), m_pending.end(), same) == m_pending.end())
+            m_pending.push_back(x);
+    }
+    if (m_pending.empty())
+        return;
+
+    if (idle) {
+        m_synced = 0;
+        m_sweepStart = GetTickCount64();
+    }
+    Pump();
+}
+
+void MonitorEngine::Stop() {
+    m_generation++;
+    m_pending.clear();
+    m_busyPlaylists.clear();
+    m_running = 0;
+    m_synced = 0;
+    m_sweepRequested = false;
+    m_sweepDueOnly = true;
+    m_sweepStart = 0;
+}
+
+int MonitorEngine::ConcurrentSyncs() {
+    return (std::max)(1, (std::min)(MaxConcurrentSyncs, Config::Current().ConcurrentSyncs));
+}
+
+void MonitorEngine::Pump() {
+    if (m_pumping)
+        return; // A sync failed right away, the loop below picks up the free slot
+
+    m_pumping = true;
+    const int maxRunning = ConcurrentSyncs();
+    for (auto it = m_pending.begin(); it != m_pending.end() && m_running < maxRunning;) {
+        if (m_busyPlaylists.find(it->PlaylistID) != m_busyPlaylists.end()) {
+            ++it;
+            continue;
+        }
+
+        Config::MonitorUrl url = *it;
+        it = m_pending.erase(it);
+
+        IAIMPPlaylist *pl = Plugin::instance()->GetPlaylistById(url.PlaylistID, false);
+        if (!pl)
+            continue;
+
+        auto state = std::make_shared<YouTubeAPI::LoadingState>();
+        state->ReferenceName = url.GroupName;
+        state->Flags = url.Flags;
+        state->IdsFirst = true; // Most of a monitored source is already in the playlist
+
+        // Newest-first sources only need their head checked, walk them fully once in a while
+        // to pick up anything that was missed (e.g. videos made public later)
+        const int64_t now = std::time(nullptr);
+        if (YouTubeAPI::IsNewestFirst(url.URL) && now - url.LastFullSync < FullSyncInterval) {
+            state->StopWhenKnown = true;
+            state->PrefetchWindow = 0; // Usually stops after the first page
+        } else {
+            for (auto &x : Config::MonitorUrls) {
+                if (x.URL == url.URL && x.PlaylistID == url.PlaylistID) {
+                    x.LastFullSync = now;
+                    Config::MarkDirty(Config::ShardMonitors);
+                }
+            }
+        }
+
+        YouTubeAPI::GetExistingTrackIds(pl, state);
+
+        m_running++;
+        m_busyPlaylists.insert(url.PlaylistID);
+        const int generation = m_generation;
+        YouTubeAPI::LoadFromUrl(url.URL, pl, state, [url, state, generation] { SyncFinished(generation, url, *state); });
+
+        // Busy playlists may have been released meanwhile
+        it = m_pending.begin();
+    }
+    m_pumping = false;
+
+    if (m_running == 0 && m_pending.empty())
+        SweepFinished();
+}
+
+void MonitorEngine::SyncFinished(int generation, const Config::MonitorUrl &url, const YouTubeAPI::LoadingState &state) {
+    if (generation != m_generation)
+        return; // Started before Stop(), not counted anymore
+
+    m_running--;
+    m_synced++;
+    m_busyPlaylists.erase(url.PlaylistID);
+
+    if (!Plugin::instance()->core())
+        return; // Shutting down
+
+    for (auto &x : Config::MonitorUrls) {
+        if (x.URL == url.URL && x.PlaylistID == url.PlaylistID) {
+            Reschedule(x, state);
+            Config::MarkDirty(Config::ShardMonitors);
+        }
+    }
+
+    Pump();
+}
+
+void MonitorEngine::SweepFinished() {
+    if (m_sweepStart == 0)
+        return;
+
+    DebugW(L"MonitorEngine: synced %d sources in %llu ms (up to %d at once)\n", m_synced, GetTickCount64() - m_sweepStart, ConcurrentSyncs());
+    m_sweepStart = 0;
+
+    Config::SaveExtendedConfig();
+
+    if (m_sweepRequested) {
+        m_sweepRequested = false;
+        StartSweep(m_sweepDueOnly);
+    }
+}
+
+void MonitorEngine::Reschedule(Config::MonitorUrl &url, const YouTubeAPI::LoadingState &state) {
+    static std::minstd_rand random(GetTickCount());
+
+    const int64_t now = std::time(nullptr);
+    const int64_t base = (std::max)(1, Config::Current().CheckEveryHours) * int64_t(60 * 60);
+
+    url.LastCheck = now;
+    int64_t interval = base;
+    if (state.Failed) {
+        url.Failures++;
+        interval = (std::min)(base << (std::min)(url.Failures, 5), (std::max)(base, MaxBackoff));
+    } else {
+        url.Failures = 0;
+        if (state.AddedItems > 0 || url.LastChange == 0)
+            url.LastChange = now;
+
+        // A source that was quiet for a week isn't likely to change within the next hour
+        interval = (std::max)(base, (std::min)(base * MaxSlowdown, (now - url.LastChange) / 4));
+    }
+
+    int64_t jitter = interval * JitterPercent / 100;
+    if (jitter > 0)
+        interval += int64_t(random() % (2 * jitter + 1)) - jitter;
+
+    url.NextDue = now + interval;
+}
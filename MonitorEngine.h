@@ -0,0 +1,50 @@
+#pragma once
+
+#include <windows.h>
+#include <deque>
+#include <unordered_set>
+#include "Config.h"
+#include "YouTubeAPI.h"
+
+// Runs a monitor sweep: every Config::MonitorUrls entry (or only the ones that
+// are due) is synced into its AIMP playlist, up to Settings::ConcurrentSyncs
+// (clamped to 1..MaxConcurrentSyncs) at a time.
+// Two syncs never target the same AIMP playlist at once, their inserts would
+// interleave.
+//
+// After a sync the source gets its next due time: the base interval
+// (CheckEveryHours) stretched up to MaxSlowdown times for sources that haven't
+// changed in a while, doubled per failure in a row, plus some jitter so
+// sources added together don't stay in lockstep.
+class MonitorEngine {
+public:
+    static const int MaxConcurrentSyncs = 16; // Cap for Settings::ConcurrentSyncs
+
+    static void StartSweep(bool dueOnly);
+    static void SyncPlaylist(const std::wstring &playlistId); // Only the sources of one AIMP playlist, alongside a running sweep
+    static void Stop();
+
+    static inline bool IsRunning() { return m_running > 0 || !m_pending.empty(); }
+    static inline bool IsSyncing(const std::wstring &playlistId) { return m_busyPlaylists.find(playlistId) != m_busyPlaylists.end(); }
+
+private:
+    static int ConcurrentSyncs(); // The setting, clamped
+    static void Pump();
+    static void SyncFinished(int generation, const Config::MonitorUrl &url, const YouTubeAPI::LoadingState &state);
+    static void Reschedule(Config::MonitorUrl &url, const YouTubeAPI::LoadingState &state);
+    static void SweepFinished();
+
+    static std::deque<Config::MonitorUrl> m_pending;
+    static std::unordered_set<std::wstring> m_busyPlaylists;
+    static int m_running;
+    static int m_generation; // Syncs started before Stop() are dropped when they finish
+    static int m_synced;
+    static bool m_sweepRequested;
+    static bool m_sweepDueOnly;
+    static bool m_pumping;
+    static ULONGLONG m_sweepStart;
+
+    MonitorEngine();
+    MonitorEngine(const MonitorEngine &);
+    MonitorEngine &operator=(const MonitorEngine &);
+};
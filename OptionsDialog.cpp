@@ -8,6 +8,7 @@
 #include "AIMPYouTube.h"
 #include "ExclusionsDialog.h"
 #include "YouTubeAPI.h"
+#include "MonitorEngine.h"
 #include <Shellapi.h>
 #include <ctime>
 
@@ -79,6 +80,9 @@ void WINAPI OptionsDialog::Notification(int ID) {
             SetDlgItemText(m_handle, IDC_CHECKEVERY,      checkEveryText0.c_str());
             SetDlgItemText(m_handle, IDC_HOURS,           checkEveryText1.c_str());
             SetDlgItemText(m_handle, IDC_MANAGEEXCLUSIONS,m_plugin->Lang(L"YouTube.Exclusions\\Header").c_str());
+            std::wstring concurrentSyncs = m_plugin->Lang(L"YouTube.Options\\ConcurrentSyncs");
+            if (!concurrentSyncs.empty())
+                SetDlgItemText(m_handle, IDC_CONCURRENTSYNCSSTR, concurrentSyncs.c_str());
             SendDlgItemMessage(m_handle, IDC_CONNECTBTN, WM_UPDATELOCALE, 0, 0);
 
             HDC hdc = GetDC(m_handle);
@@ -115,15 +119,17 @@ void WINAPI OptionsDialog::Notification(int ID) {
         case AIMP_SERVICE_OPTIONSDIALOG_NOTIFICATION_LOAD: {
             m_userId    = Config::GetString(L"UserId");
             m_userName  = Config::GetString(L"UserName");
-            m_userYTName= Config::GetString(L"UserYTName");
+            m_userYTName= Config::Current().UserYTName;
             m_userInfo  = Config::GetString(L"UserInfo");
 
-            SendDlgItemMessage(m_handle, IDC_MONITORPLAYLISTS, BM_SETCHECK, Config::GetInt32(L"MonitorUserPlaylists", 1), 0);
-            SendDlgItemMessage(m_handle, IDC_CHECKONSTARTUP, BM_SETCHECK, Config::GetInt32(L"CheckOnStartup", 1), 0);
-            SendDlgItemMessage(m_handle, IDC_CHECKEVERY, BM_SETCHECK, Config::GetInt32(L"CheckEveryEnabled", 1), 0);
-            SendDlgItemMessage(m_handle, IDC_CHECKEVERYVALUESPIN, UDM_SETPOS32, 0, Config::GetInt32(L"CheckEveryHours", 1));
-			SendDlgItemMessage(m_handle, IDC_YOUTUBEDLCMD, WM_SETTEXT, 0, (LPARAM)Plugin::instance()->YoutubeDLCmd().c_str());
-			SetDlgItemInt(m_handle, IDC_YOUTUBEDLTIMEOUT, Plugin::instance()->YoutubeDLTimeout(), FALSE);
+            const Config::Settings &settings = Config::Current();
+            SendDlgItemMessage(m_handle, IDC_MONITORPLAYLISTS, BM_SETCHECK, settings.MonitorUserPlaylists, 0);
+            SendDlgItemMessage(m_handle, IDC_CHECKONSTARTUP, BM_SETCHECK, settings.CheckOnStartup, 0);
+            SendDlgItemMessage(m_handle, IDC_CHECKEVERY, BM_SETCHECK, settings.CheckEveryEnabled, 0);
+            SendDlgItemMessage(m_handle, IDC_CHECKEVERYVALUESPIN, UDM_SETPOS32, 0, settings.CheckEveryHours);
+			SendDlgItemMessage(m_handle, IDC_YOUTUBEDLCMD, WM_SETTEXT, 0, (LPARAM)settings.YoutubeDLCmd.c_str());
+			SetDlgItemInt(m_handle, IDC_YOUTUBEDLTIMEOUT, settings.YoutubeDLTimeout, FALSE);
+            SetDlgItemInt(m_handle, IDC_CONCURRENTSYNCS, settings.ConcurrentSyncs, FALSE);
 
             BOOL enable = SendDlgItemMessage(m_handle, IDC_CHECKEVERY, BM_GETCHECK, 0, 0) == BST_CHECKED;
             EnableWindow(GetDlgItem(m_handle, IDC_CHECKEVERYVALUE), enable);
@@ -133,9 +139,9 @@ void WINAPI OptionsDialog::Notification(int ID) {
             LoadProfileInfo();
         } break;
         case AIMP_SERVICE_OPTIONSDIALOG_NOTIFICATION_SAVE: {
+            Config::WaitUntilLoaded();
             Config::SetString(L"UserId", m_userId);
             Config::SetString(L"UserName", m_userName);
-            Config::SetString(L"UserYTName", m_userYTName);
             Config::SetString(L"UserInfo", m_userInfo);			
 
             if (m_userId.empty()) {
@@ -143,27 +149,30 @@ void WINAPI OptionsDialog::Notification(int ID) {
                 Config::Delete(L"RefreshToken");
                 Config::Delete(L"TokenExpires");
             }
+            Config::Settings settings = Config::Current();
+            settings.UserYTName = m_userYTName;
             if (m_handle) {
-                Config::SetInt32(L"CheckEveryHours", SendDlgItemMessage(m_handle, IDC_CHECKEVERYVALUESPIN, UDM_GETPOS32, 0, 0));
+                settings.CheckEveryHours = SendDlgItemMessage(m_handle, IDC_CHECKEVERYVALUESPIN, UDM_GETPOS32, 0, 0);
 
-                Config::SetInt32(L"CheckEveryEnabled", SendDlgItemMessage(m_handle, IDC_CHECKEVERY, BM_GETCHECK, 0, 0) == BST_CHECKED);
-                Config::SetInt32(L"CheckOnStartup", SendDlgItemMessage(m_handle, IDC_CHECKONSTARTUP, BM_GETCHECK, 0, 0) == BST_CHECKED);
-                Config::SetInt32(L"MonitorUserPlaylists", SendDlgItemMessage(m_handle, IDC_MONITORPLAYLISTS, BM_GETCHECK, 0, 0) == BST_CHECKED);
+                settings.CheckEveryEnabled = SendDlgItemMessage(m_handle, IDC_CHECKEVERY, BM_GETCHECK, 0, 0) == BST_CHECKED;
+                settings.CheckOnStartup = SendDlgItemMessage(m_handle, IDC_CHECKONSTARTUP, BM_GETCHECK, 0, 0) == BST_CHECKED;
+                settings.MonitorUserPlaylists = SendDlgItemMessage(m_handle, IDC_MONITORPLAYLISTS, BM_GETCHECK, 0, 0) == BST_CHECKED;
 
 				WCHAR buff[4096];
 				SendDlgItemMessage(m_handle, IDC_YOUTUBEDLCMD, WM_GETTEXT, 4096, (LPARAM)buff);
-				Plugin::instance()->YoutubeDLCmd(buff);
-				Plugin::instance()->YoutubeDLTimeout(GetDlgItemInt(m_handle, IDC_YOUTUBEDLTIMEOUT, nullptr, FALSE));
+				settings.YoutubeDLCmd = buff;
+				settings.YoutubeDLTimeout = GetDlgItemInt(m_handle, IDC_YOUTUBEDLTIMEOUT, nullptr, FALSE);
+                settings.ConcurrentSyncs = (std::max)(1, (std::min)(MonitorEngine::MaxConcurrentSyncs, (int)GetDlgItemInt(m_handle, IDC_CONCURRENTSYNCS, nullptr, FALSE)));
             }
+            Config::SaveSettings(settings);
 
             if (m_userPlaylists.size() > 0) {
                 Config::UserPlaylists.clear();
                 Config::UserPlaylists.swap(m_userPlaylists);
+                Config::MarkDirty(Config::ShardAllPlaylists);
             }
             m_plugin->UpdatePlaylistMenu();
             Config::SaveExtendedConfig();
-
-            m_plugin->StartMonitorTimer();
         } break;
     }
 }
@@ -716,6 +725,7 @@ BOOL CALLBACK OptionsDialog::DlgProc(HWND hwnd, UINT Msg, WPARAM wParam, LPARAM
                         dialog->m_userYTName.clear();
                         dialog->m_userPlaylists.clear();
                         Config::UserPlaylists.clear();
+                        Config::MarkDirty(Config::ShardAllPlaylists);
                         std::wstring path = Config::PluginConfigFolder() + L"user_avatar.jpg";
                         DeleteFile(path.c_str());
 
@@ -725,6 +735,7 @@ BOOL CALLBACK OptionsDialog::DlgProc(HWND hwnd, UINT Msg, WPARAM wParam, LPARAM
                 break;
 				case IDC_YOUTUBEDLCMD:
 				case IDC_YOUTUBEDLTIMEOUT:
+                case IDC_CONCURRENTSYNCS:
                 case IDC_CHECKEVERYVALUE:
                     if (HIWORD(wParam) == EN_CHANGE) {
                         if (dialog)
@@ -771,7 +782,7 @@ void OptionsDialog::Connect(std::function<void()> onFinished) {
                 s3 = Tools::ToString(Plugin::instance()->Lang(L"YouTube\\ConnectStatusError", 0)),
                 s4 = Tools::ToString(Plugin::instance()->Lang(L"YouTube\\ConnectStatusError", 1));
     
-    (new TcpServer(35910, [onFinished, s1, s2, s3, s4](TcpServer *s, char *request, std::string &response) -> bool {
+    TcpServer *server = new TcpServer(35910, [onFinished, s1, s2, s3, s4](TcpServer *s, char *request, std::string &response) -> bool {
         response = "HTTP/1.1 200 OK\r\n"
                    "Content-Type: text/html\r\n"
                    "Connection: close\r\n"
@@ -818,7 +829,9 @@ void OptionsDialog::Connect(std::function<void()> onFinished) {
         Tools::ReplaceString("%TITLE%", s3, response);
         Tools::ReplaceString("%TEXT%", s4, response);
         return true;
-    }))->Start();
+    });
+    if (!server->Start())
+        delete server; // Deletes itself once the redirect came in otherwise
 
     ShellExecuteA(Plugin::instance()->GetMainWindowHandle(),
                   "open",
@@ -832,7 +845,8 @@ static std::vector<int> s_tabOrder({ IDC_CONNECTBTN,
                                      IDC_CHECKEVERY,
                                      IDC_CHECKEVERYVALUE,
 									 IDC_YOUTUBEDLCMD,
-                                     IDC_YOUTUBEDLTIMEOUT
+                                     IDC_YOUTUBEDLTIMEOUT,
+                                     IDC_CONCURRENTSYNCS
 });
 
 BOOL WINAPI OptionsDialog::SelectFirstControl() {
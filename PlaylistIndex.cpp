@@ -0,0 +1,223 @@
+#include "PlaylistIndex.h"
+
+#include "AIMPYouTube.h"
+#include "PlaylistSnapshot.h"
+#include "Tools.h"
+#include <algorithm>
+
+std::unordered_map<std::wstring, PlaylistIndex::Entry> PlaylistIndex::m_entries;
+
+void WINAPI PlaylistIndex::ContentListener::Changed(DWORD Flags) {
+    auto it = m_entries.find(m_playlistId);
+    if (it == m_entries.end())
+        return;
+
+    if (Flags & (AIMP_PLAYLIST_NOTIFY_SELECTION | AIMP_PLAYLIST_NOTIFY_CONTENT))
+        it->second.SelectionStale = true;
+    if ((Flags & AIMP_PLAYLIST_NOTIFY_CONTENT) && it->second.Mutations == 0)
+        it->second.Stale = true;
+}
+
+void WINAPI PlaylistIndex::ContentListener::Removed() {
+    Drop(m_playlistId);
+}
+
+PlaylistIndex::Mutation::Mutation(IAIMPPlaylist *pl) : m_playlistId(Plugin::instance()->PlaylistId(pl)) {
+    // Attached even if not indexed yet, the lookups made inside it build the rows
+    if (Entry *entry = Attach(pl))
+        entry->Mutations++;
+    else
+        m_playlistId.clear();
+}
+
+PlaylistIndex::Mutation::~Mutation() {
+    if (m_playlistId.empty())
+        return;
+
+    auto it = m_entries.find(m_playlistId);
+    if (it != m_entries.end())
+        it->second.Mutations--;
+}
+
+void PlaylistIndex::Deinit() {
+    for (auto &x : m_entries) {
+        Clear(x.second);
+        x.second.Playlist->ListenerRemove(x.second.Listener);
+        x.second.Listener->Release();
+        x.second.Playlist->Release();
+    }
+    m_entries.clear();
+}
+
+void PlaylistIndex::Drop(const std::wstring &playlistId) {
+    auto it = m_entries.find(playlistId);
+    if (it == m_entries.end())
+        return;
+
+    // The listener may be the caller, keep it alive until we're out
+    Entry entry = it->second;
+    m_entries.erase(it);
+
+    Clear(entry);
+    entry.Playlist->ListenerRemove(entry.Listener);
+    entry.Playlist->Release();
+    entry.Listener->Release();
+}
+
+PlaylistIndex::Entry *PlaylistIndex::Attach(IAIMPPlaylist *pl) {
+    if (!pl)
+        return nullptr;
+
+    const std::wstring playlistId = Plugin::instance()->PlaylistId(pl);
+    if (playlistId.empty())
+        return nullptr;
+
+    auto it = m_entries.find(playlistId);
+    if (it == m_entries.end()) {
+        it = m_entries.emplace(playlistId, Entry()).first;
+        Entry &entry = it->second;
+        entry.Playlist = pl;
+        entry.Playlist->AddRef();
+        entry.Listener = new ContentListener(playlistId);
+        entry.Listener->AddRef();
+        entry.Playlist->ListenerAdd(entry.Listener);
+    }
+    return &it->second;
+}
+
+PlaylistIndex::Entry *PlaylistIndex::Get(IAIMPPlaylist *pl) {
+    Entry *entry = Attach(pl);
+    if (entry && entry->Stale)
+        Build(*entry);
+
+    return entry;
+}
+
+void PlaylistIndex::Build(Entry &entry) {
+    Clear(entry);
+
+    PlaylistSnapshot snapshot(entry.Playlist);
+    entry.Rows.reserve(snapshot.Count());
+    for (int i = 0, n = snapshot.Count(); i < n; ++i) {
+        if (!snapshot.HasId(i))
+            continue;
+
+        IAIMPPlaylistItem *item = snapshot.Item(i);
+        item->AddRef();
+        entry.Rows[snapshot.IdString(i)].push_back(item);
+    }
+    entry.Stale = false;
+}
+
+void PlaylistIndex::Clear(Entry &entry) {
+    for (auto &x : entry.Rows) {
+        for (auto item : x.second)
+            item->Release();
+    }
+    entry.Rows.clear();
+    entry.Stale = true;
+}
+
+bool PlaylistIndex::Contains(IAIMPPlaylist *pl, const std::wstring &videoId) {
+    Entry *entry = Get(pl);
+    return entry && entry->Rows.find(videoId) != entry->Rows.end();
+}
+
+void PlaylistIndex::Ids(IAIMPPlaylist *pl, std::unordered_set<std::wstring> &out) {
+    if (Entry *entry = Get(pl)) {
+        out.reserve(out.size() + entry->Rows.size());
+        for (const auto &x : entry->Rows)
+            out.insert(x.first);
+    }
+}
+
+void PlaylistIndex::ForRows(IAIMPPlaylist *pl, const std::wstring &videoId, std::function<void(IAIMPPlaylistItem *)> callback) {
+    Entry *entry = Get(pl);
+    if (!entry || !callback)
+        return;
+
+    auto it = entry->Rows.find(videoId);
+    if (it != entry->Rows.end()) {
+        for (auto item : it->second)
+            callback(item);
+    }
+}
+
+int PlaylistIndex::Delete(IAIMPPlaylist *pl, const std::wstring &videoId) {
+    Entry *entry = Get(pl);
+    if (!entry)
+        return 0;
+
+    auto it = entry->Rows.find(videoId);
+    if (it == entry->Rows.end())
+        return 0;
+
+    std::vector<IAIMPPlaylistItem *> rows;
+    rows.swap(it->second);
+    entry->Rows.erase(it);
+
+    int deleted = 0;
+    entry->Mutations++;
+    for (auto item : rows) {
+        if (SUCCEEDED(pl->Delete(item)))
+            deleted++;
+        item->Release();
+    }
+    entry->Mutations--;
+    return deleted;
+}
+
+const std::vector<std::wstring> &PlaylistIndex::Selection(IAIMPPlaylist *pl) {
+    static const std::vector<std::wstring> none;
+    Entry *entry = Attach(pl);
+    if (!entry)
+        return none;
+
+    if (entry->SelectionStale) {
+        entry->Selected.clear();
+        IAIMPObjectList *files = nullptr;
+        if (SUCCEEDED(pl->GetFiles(AIMP_PLAYLIST_GETFILES_FLAGS_SELECTED_ONLY, &files)) && files) {
+            for (int i = 0, n = files->GetCount(); i < n; ++i) {
+                IAIMPString *url = nullptr;
+                if (SUCCEEDED(files->GetObject(i, IID_IAIMPString, reinterpret_cast<void **>(&url)))) {
+                    std::wstring id = Tools::TrackIdFromUrl(url->GetData());
+                    if (!id.empty())
+                        entry->Selected.push_back(std::move(id));
+                    url->Release();
+                }
+            }
+            files->Release();
+        }
+        entry->SelectionStale = false;
+    }
+    return entry->Selected;
+}
+
+void PlaylistIndex::Added(IAIMPPlaylist *pl, IAIMPPlaylistItem *item, const std::wstring &videoId) {
+    const std::wstring playlistId = Plugin::instance()->PlaylistId(pl);
+    auto it = m_entries.find(playlistId);
+    if (it == m_entries.end() || it->second.Stale || videoId.empty())
+        return; // Built on first use, with this row
+
+    item->AddRef();
+    it->second.Rows[videoId].push_back(item);
+}
+
+void PlaylistIndex::Removed(IAIMPPlaylist *pl, IAIMPPlaylistItem *item, const std::wstring &videoId) {
+    const std::wstring playlistId = Plugin::instance()->PlaylistId(pl);
+    auto it = m_entries.find(playlistId);
+    if (it == m_entries.end() || it->second.Stale)
+        return;
+
+    auto rows = it->second.Rows.find(videoId);
+    if (rows == it->second.Rows.end())
+        return;
+
+    auto row = std::find(rows->second.begin(), rows->second.end(), item);
+    if (row != rows->second.end()) {
+        (*row)->Release();
+        rows->second.erase(row);
+        if (rows->second.empty())
+            it->second.Rows.erase(rows);
+    }
+}
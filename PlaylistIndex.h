@@ -0,0 +1,100 @@
+#pragma once
+
+#include <windows.h>
+#include <string>
+#include <vector>
+#include <functional>
+#include <unordered_map>
+#include <unordered_set>
+#include "SDK/apiPlaylists.h"
+#include "IUnknownInterfaceImpl.h"
+
+// Video ID -> rows index of AIMP playlists. A playlist is walked once, on the
+// first lookup, and from then on kept current by the plugin's own add and delete
+// paths. Changes made by anything else (the user, other plugins) show up as
+// AIMP_PLAYLIST_NOTIFY_CONTENT on the playlist's listener and just mark the
+// index stale, the next lookup walks the playlist again.
+//
+// Rows are held AddRef'd, so a stale index never points at freed items.
+//
+// Selection() keeps the video IDs of the selected rows, read with GetFiles()
+// and dropped on the next selection or content change. It doesn't need the
+// rows index, so a context menu never walks the playlist.
+//
+// Main thread only.
+class PlaylistIndex {
+public:
+    static void Deinit();
+
+    static bool Contains(IAIMPPlaylist *pl, const std::wstring &videoId);
+    static void Ids(IAIMPPlaylist *pl, std::unordered_set<std::wstring> &out);
+    static void ForRows(IAIMPPlaylist *pl, const std::wstring &videoId, std::function<void(IAIMPPlaylistItem *)> callback);
+    static int Delete(IAIMPPlaylist *pl, const std::wstring &videoId); // Returns the number of rows deleted
+    static const std::vector<std::wstring> &Selection(IAIMPPlaylist *pl); // Video IDs of the selected rows
+
+    // The plugin's own changes, made inside a Mutation
+    static void Added(IAIMPPlaylist *pl, IAIMPPlaylistItem *item, const std::wstring &videoId);
+    static void Removed(IAIMPPlaylist *pl, IAIMPPlaylistItem *item, const std::wstring &videoId);
+
+    static void Drop(const std::wstring &playlistId); // Playlist closed
+
+    // Content notifications for pl are the plugin's own while one is alive. AIMP
+    // sends them at EndUpdate(), so it has to be opened before BeginUpdate().
+    class Mutation {
+    public:
+        explicit Mutation(IAIMPPlaylist *pl);
+        ~Mutation();
+    private:
+        std::wstring m_playlistId;
+        Mutation(const Mutation &);
+        Mutation &operator=(const Mutation &);
+    };
+
+private:
+    class ContentListener : public IUnknownInterfaceImpl<IAIMPPlaylistListener> {
+    public:
+        explicit ContentListener(const std::wstring &playlistId) : m_playlistId(playlistId) {}
+
+        virtual HRESULT WINAPI QueryInterface(REFIID riid, LPVOID* ppvObj) {
+            if (!ppvObj) return E_POINTER;
+
+            if (riid == IID_IAIMPPlaylistListener) {
+                *ppvObj = this;
+                AddRef();
+                return S_OK;
+            }
+
+            return E_NOINTERFACE;
+        }
+
+        virtual void WINAPI Activated() {}
+        virtual void WINAPI Changed(DWORD Flags);
+        virtual void WINAPI Removed();
+
+    private:
+        std::wstring m_playlistId;
+    };
+
+    struct Entry {
+        IAIMPPlaylist *Playlist;
+        ContentListener *Listener;
+        bool Stale;
+        int Mutations;
+        std::unordered_map<std::wstring, std::vector<IAIMPPlaylistItem *>> Rows;
+        bool SelectionStale;
+        std::vector<std::wstring> Selected;
+
+        Entry() : Playlist(nullptr), Listener(nullptr), Stale(true), Mutations(0), SelectionStale(true) {}
+    };
+
+    static Entry *Attach(IAIMPPlaylist *pl); // nullptr if pl has no ID
+    static Entry *Get(IAIMPPlaylist *pl);    // Attached, with the rows built and current
+    static void Build(Entry &entry);
+    static void Clear(Entry &entry);
+
+    static std::unordered_map<std::wstring, Entry> m_entries; // By AIMP playlist ID
+
+    PlaylistIndex();
+    PlaylistIndex(const PlaylistIndex &);
+    PlaylistIndex &operator=(const PlaylistIndex &);
+};
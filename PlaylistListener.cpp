@@ -1,6 +1,7 @@
 #include "PlaylistListener.h"
 #include "Config.h"
 #include "AIMPYouTube.h"
+#include "PlaylistIndex.h"
 #include <algorithm>
 
 void WINAPI PlaylistListener::PlaylistActivated(IAIMPPlaylist *Playlist) {
@@ -15,11 +16,16 @@ void WINAPI PlaylistListener::PlaylistRemoved(IAIMPPlaylist *Playlist) {
     std::wstring playlistId = Plugin::instance()->PlaylistId(Playlist);
 
     if (!playlistId.empty()) {
-        Config::MonitorUrls.erase(
-            std::remove_if(Config::MonitorUrls.begin(), Config::MonitorUrls.end(), [&](const Config::MonitorUrl &element) -> bool {
-                return element.PlaylistID == playlistId;
-            }
-        ), Config::MonitorUrls.end());
+        PlaylistIndex::Drop(playlistId);
+
+        Config::WaitUntilLoaded();
+        auto it = std::remove_if(Config::MonitorUrls.begin(), Config::MonitorUrls.end(), [&](const Config::MonitorUrl &element) -> bool {
+            return element.PlaylistID == playlistId;
+        });
+        if (it != Config::MonitorUrls.end()) {
+            Config::MonitorUrls.erase(it, Config::MonitorUrls.end());
+            Config::MarkDirty(Config::ShardMonitors);
+            Config::SaveExtendedConfig();
+        }
     }
-    Config::SaveExtendedConfig();
 }
@@ -0,0 +1,564 @@
+#include "PlaylistMutations.h"
+#include "AIMPYouTube.h"
+#include "AimpHTTP.h"
+#include "MainThread.h"
+#include "MonitorEngine.h"
+#include "PlaylistIndex.h"
+#include "Timer.h"
+#include "Tools.h"
+#include "YouTubeAPI.h"
+#include <memory>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+
+static const int          MaxInFlight   = 4;              // Ops at once, each is one or two requests
+static const unsigned int MinRetryDelay = 30 * 1000;      // ms before retrying after going offline
+static const unsigned int MaxRetryDelay = 10 * 60 * 1000; // Doubled per retry up to this
+
+std::deque<PlaylistMutations::Op> PlaylistMutations::m_queue;
+std::unordered_map<std::wstring, int> PlaylistMutations::m_queued;
+std::unordered_set<std::wstring> PlaylistMutations::m_busy;
+std::vector<PlaylistMutations::Op> PlaylistMutations::m_local;
+std::unordered_set<std::wstring> PlaylistMutations::m_resync;
+std::map<uint64_t, PlaylistMutations::Op> PlaylistMutations::m_journal;
+FILE *PlaylistMutations::m_journalFile = nullptr;
+uint64_t PlaylistMutations::m_nextSeq = 0;
+int PlaylistMutations::m_inFlight = 0;
+bool PlaylistMutations::m_pumpPosted = false;
+bool PlaylistMutations::m_offline = false;
+bool PlaylistMutations::m_retryPending = false;
+unsigned int PlaylistMutations::m_retryDelay = MinRetryDelay;
+ULONGLONG PlaylistMutations::m_started = 0;
+int PlaylistMutations::m_added = 0;
+int PlaylistMutations::m_removed = 0;
+int PlaylistMutations::m_failed = 0;
+int PlaylistMutations::m_replayed = 0;
+int PlaylistMutations::m_roundTrips = 0;
+double PlaylistMutations::m_replayRate = 0;
+
+namespace {
+    // "+ seq playlistId videoId" or "- ...", "= seq" once it's done. IDs never contain spaces.
+    void WriteEntry(FILE *file, bool add, uint64_t seq, const std::wstring &playlistId, const std::wstring &videoId) {
+        fprintf(file, "%c %llu %s %s\n", add ? '+' : '-', (unsigned long long)seq, Tools::ToString(playlistId).c_str(), Tools::ToString(videoId).c_str());
+    }
+}
+
+void PlaylistMutations::Start() {
+    LoadJournal();
+    if (m_journal.empty())
+        return;
+
+    for (auto it = m_journal.begin(); it != m_journal.end();) {
+        const Op &op = it->second;
+        Config::Playlist *pl = Find(op.PlaylistId);
+        if (!pl) {
+            it = m_journal.erase(it); // The playlist is gone
+            continue;
+        }
+
+        // The saved config may predate the edit
+        if (op.Type == Add) {
+            pl->Items.insert(op.VideoId);
+        } else {
+            pl->Items.erase(op.VideoId);
+        }
+        Config::MarkPlaylistDirty(pl->ID);
+
+        m_local.push_back(op);
+        m_queued[Target(op)]++;
+        m_queue.push_back(op);
+        ++it;
+    }
+
+    // Only what's still pending goes back to the file
+    const std::wstring path = JournalFile();
+    if (m_journal.empty()) {
+        DeleteFile(path.c_str());
+        return;
+    }
+
+    FILE *file = nullptr;
+    if (_wfopen_s(&file, (path + L".tmp").c_str(), L"wb") == 0) {
+        for (const auto &x : m_journal) {
+            WriteEntry(file, x.second.Type == Add, x.first, x.second.PlaylistId, x.second.VideoId);
+        }
+        fclose(file);
+        MoveFileEx((path + L".tmp").c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING);
+    }
+
+    DebugW(L"PlaylistMutations: replaying %u journaled edits\n", (unsigned)m_journal.size());
+    m_started = GetTickCount64();
+    if (!m_pumpPosted) {
+        m_pumpPosted = MainThread::Post(Pump);
+    }
+}
+
+void PlaylistMutations::Stop() {
+    // Whatever is still pending stays in the journal for the next session
+    m_queue.clear();
+    m_queued.clear();
+    m_local.clear();
+    m_resync.clear();
+    m_journal.clear();
+
+    if (m_journalFile) {
+        fclose(m_journalFile);
+        m_journalFile = nullptr;
+    }
+}
+
+void PlaylistMutations::Resume() {
+    m_offline = false;
+    m_retryDelay = MinRetryDelay;
+    if (!m_queue.empty() && !m_pumpPosted) {
+        m_pumpPosted = MainThread::Post(Pump);
+    }
+}
+
+void PlaylistMutations::Enqueue(Kind kind, const std::wstring &playlistId, const std::wstring &videoId) {
+    Config::Playlist *pl = Find(playlistId);
+    if (!pl || videoId.empty())
+        return;
+
+    Op op = { kind, playlistId, videoId, 0, false };
+    const std::wstring target = Target(op);
+    bool cancelled = false;
+    auto queued = m_queued.find(target);
+    if (queued != m_queued.end()) {
+        // The last queued edit of this video is what the playlist will end up with
+        auto last = std::find_if(m_queue.rbegin(), m_queue.rend(), [&op](const Op &x) -> bool {
+            return x.PlaylistId == op.PlaylistId && x.VideoId == op.VideoId;
+        });
+        if (last->Type == kind)
+            return;
+
+        if (!last->Replayed) {
+            // Undoes an edit that wasn't sent yet, neither of them has to be
+            Complete(last->Seq);
+            m_queue.erase(std::next(last).base());
+            if (--queued->second == 0)
+                m_queued.erase(queued);
+            cancelled = true;
+        }
+    } else if ((kind == Add) == (pl->Items.find(videoId) != pl->Items.end())) {
+        return; // Already the case
+    }
+
+    if (kind == Add) {
+        pl->Items.insert(videoId);
+    } else {
+        pl->Items.erase(videoId);
+    }
+    Config::MarkPlaylistDirty(pl->ID);
+    m_local.push_back(op);
+
+    if (!cancelled) {
+        op.Seq = ++m_nextSeq;
+        Record(op);
+        m_queued[target]++;
+        m_queue.push_back(std::move(op));
+    }
+
+    if (m_started == 0)
+        m_started = GetTickCount64();
+
+    // A whole selection is queued before the first request goes out
+    if (!m_pumpPosted) {
+        m_pumpPosted = MainThread::Post(Pump);
+    }
+}
+
+void PlaylistMutations::PendingRemoves(const std::wstring &playlistId, std::unordered_set<std::wstring> &out) {
+    for (const auto &x : m_journal) {
+        if (x.second.Type == Remove && x.second.PlaylistId == playlistId)
+            out.insert(x.second.VideoId);
+    }
+}
+
+Config::Playlist *PlaylistMutations::Find(const std::wstring &playlistId) {
+    for (auto &x : Config::UserPlaylists) {
+        if (x.ID == playlistId)
+            return &x;
+    }
+    return nullptr;
+}
+
+void PlaylistMutations::Pump() {
+    m_pumpPosted = false;
+
+    // Rows of everything queued meanwhile, one update per playlist
+    if (!m_local.empty()) {
+        std::vector<Op> local;
+        local.swap(m_local);
+        ApplyRows(local, false);
+    }
+
+    if (!m_queue.empty() && !Plugin::instance()->isConnected())
+        return; // Kept in the journal until Resume()
+
+    for (auto it = m_queue.begin(); it != m_queue.end() && m_inFlight < MaxInFlight && !m_offline;) {
+        const std::wstring target = Target(*it);
+        if (m_busy.find(target) != m_busy.end()) {
+            ++it;
+            continue;
+        }
+
+        Op op = std::move(*it);
+        m_queue.erase(it);
+        if (--m_queued[target] == 0)
+            m_queued.erase(target);
+
+        m_busy.insert(target);
+        m_inFlight++;
+        Send(op);
+
+        it = m_queue.begin();
+    }
+
+    if (m_inFlight == 0 && m_queue.empty())
+        BatchFinished();
+}
+
+void PlaylistMutations::Send(const Op &op) {
+    Config::Playlist *pl = Find(op.PlaylistId);
+    if (!pl) {
+        Done(op, Rejected, std::wstring()); // The playlist is gone
+        return;
+    }
+
+    auto cached = pl->ItemIds.find(op.VideoId);
+    if (op.Type == Add) {
+        if (cached != pl->ItemIds.end()) {
+            Done(op, Sent, cached->second); // A sync has seen it there
+        } else if (op.Replayed) {
+            Lookup(op); // The first attempt may have made it
+        } else {
+            Insert(op);
+        }
+    } else if (cached != pl->ItemIds.end()) {
+        Delete(op, cached->second, true);
+    } else {
+        Lookup(op);
+    }
+}
+
+PlaylistMutations::Result PlaylistMutations::Classify(unsigned char *data, ResponseDecoder::Response &r, bool expectBody) {
+    if (!data || AimpHTTP::Failed())
+        return Offline;
+    if (!*data)
+        return expectBody ? Offline : Sent; // A DELETE answers without a body
+
+    if (!ResponseDecoder::Decode(reinterpret_cast<char *>(data), r))
+        return Offline; // Not the API answering, e.g. a captive portal
+    if (r.Error)
+        return r.ErrorCode == 401 || r.ErrorCode == 429 || r.ErrorCode >= 500 ? Offline : Rejected;
+    return Sent;
+}
+
+void PlaylistMutations::Insert(const Op &op) {
+    std::string postData("{"
+        "\"snippet\": {"
+            "\"playlistId\": \"" + Tools::ToString(op.PlaylistId) + "\","
+            "\"resourceId\": {\"videoId\": \"" + Tools::ToString(op.VideoId) + "\", \"kind\": \"youtube#video\" }"
+        "}"
+    "}");
+
+    m_roundTrips++;
+    bool started = AimpHTTP::Post(L"https://www.googleapis.com/youtube/v3/playlistItems?part=snippet&fields=id\r\nContent-Type: application/json"
+                                  L"\r\nAuthorization: Bearer " + Plugin::instance()->getAccessToken(), postData, [op](unsigned char *data, int size) {
+        // The new playlistItem ID, kept so removing the video later is a single request
+        ResponseDecoder::Response r;
+        Result result = Classify(data, r, true);
+        const std::wstring itemId = result == Sent && !r.Items.empty() ? r.Items[0].Id : std::wstring();
+        if (result == Sent && itemId.empty())
+            result = Rejected;
+
+        MainThread::Post([op, result, itemId] {
+            Done(op, result, itemId);
+        });
+    });
+
+    if (!started)
+        NotStarted(op);
+}
+
+void PlaylistMutations::Lookup(const Op &op) {
+    m_roundTrips++;
+    bool started = AimpHTTP::Get(L"https://content.googleapis.com/youtube/v3/playlistItems?part=id&videoId=" + op.VideoId + L"&playlistId=" + op.PlaylistId +
+                                 L"&fields=items%2Fid\r\nAuthorization: Bearer " + Plugin::instance()->getAccessToken(), [op](unsigned char *data, int size) {
+        ResponseDecoder::Response r;
+        const Result result = Classify(data, r, true);
+        const std::wstring itemId = result == Sent && !r.Items.empty() ? r.Items[0].Id : std::wstring();
+
+        MainThread::Post([op, result, itemId] {
+            if (result != Sent) {
+                Done(op, result, std::wstring());
+            } else if (op.Type == Add) {
+                if (itemId.empty()) {
+                    Insert(op);
+                } else {
+                    Done(op, Sent, itemId); // Already added
+                }
+            } else if (itemId.empty()) {
+                Done(op, Sent, std::wstring()); // Not in the playlist (anymore)
+            } else {
+                Delete(op, itemId, false);
+            }
+        });
+    });
+
+    if (!started)
+        NotStarted(op);
+}
+
+void PlaylistMutations::Delete(const Op &op, const std::wstring &itemId, bool cached) {
+    std::wstring url(L"https://www.googleapis.com/youtube/v3/playlistItems?id=" + itemId);
+    url += L"\r\nX-HTTP-Method-Override: DELETE";
+    url += L"\r\nAuthorization: Bearer " + Plugin::instance()->getAccessToken();
+
+    m_roundTrips++;
+    bool started = AimpHTTP::Post(url, std::string(), [op, cached](unsigned char *data, int size) {
+        ResponseDecoder::Response r;
+        const Result result = Classify(data, r, false);
+
+        MainThread::Post([op, result, cached] {
+            if (result == Rejected && cached) {
+                // Removed on the site since the last sync, look the video up instead
+                if (Config::Playlist *pl = Find(op.PlaylistId))
+                    pl->ItemIds.erase(op.VideoId);
+                Lookup(op);
+                return;
+            }
+            Done(op, result, std::wstring());
+        });
+    });
+
+    if (!started)
+        NotStarted(op);
+}
+
+void PlaylistMutations::NotStarted(const Op &op) {
+    // Like a request without a response, through the queue as usual so Pump() isn't re-entered
+    MainThread::Post([op] {
+        Done(op, Offline, std::wstring());
+    });
+}
+
+void PlaylistMutations::Done(const Op &op, Result result, const std::wstring &itemId) {
+    m_inFlight--;
+    m_busy.erase(Target(op));
+
+    Config::Playlist *pl = Find(op.PlaylistId);
+    if (result == Offline && pl) {
+        // First in line once back online
+        Op retry(op);
+        retry.Replayed = true;
+        m_queued[Target(retry)]++;
+        m_queue.push_front(std::move(retry));
+        GoOffline();
+    } else if (result == Sent && pl) {
+        if (op.Type == Add) {
+            if (!itemId.empty())
+                pl->ItemIds[op.VideoId] = itemId;
+            m_added++;
+        } else {
+            pl->ItemIds.erase(op.VideoId);
+            m_removed++;
+        }
+        if (op.Replayed)
+            m_replayed++;
+        m_retryDelay = MinRetryDelay;
+        Complete(op.Seq);
+    } else {
+        m_failed++;
+        Complete(op.Seq);
+
+        // Undone locally, unless a later edit of the video is queued
+        if (pl && m_queued.find(Target(op)) == m_queued.end()) {
+            if (op.Type == Add) {
+                pl->Items.erase(op.VideoId);
+            } else {
+                pl->Items.insert(op.VideoId);
+            }
+            Config::MarkPlaylistDirty(pl->ID);
+            ApplyRows(std::vector<Op>(1, op), true);
+        }
+    }
+
+    if (!m_pumpPosted) {
+        m_pumpPosted = MainThread::Post(Pump);
+    }
+}
+
+void PlaylistMutations::ApplyRows(const std::vector<Op> &ops, bool undo) {
+    std::unordered_map<std::wstring, std::vector<const Op *>> byPlaylist;
+    for (const auto &op : ops) {
+        Config::Playlist *pl = Find(op.PlaylistId);
+        if (pl && !pl->AIMPPlaylistId.empty())
+            byPlaylist[pl->AIMPPlaylistId].push_back(&op);
+    }
+
+    for (const auto &x : byPlaylist) {
+        IAIMPPlaylist *playlist = Plugin::instance()->GetPlaylistById(x.first, false);
+        if (!playlist)
+            continue;
+
+        std::vector<YouTubeAPI::VideoItem> items;
+        PlaylistIndex::Mutation mutation(playlist);
+        playlist->BeginUpdate();
+        for (const Op *op : x.second) {
+            if ((op->Type == Add) == undo) {
+                PlaylistIndex::Delete(playlist, op->VideoId);
+            } else if (auto ti = Tools::TrackInfo(op->VideoId)) {
+                YouTubeAPI::VideoItem v;
+                v.Id = op->VideoId;
+                v.Title = ti->Name;
+                v.Artwork = ti->Artwork;
+                v.Duration = (int64_t)ti->Duration;
+                items.push_back(std::move(v));
+            } else {
+                m_resync.insert(x.first); // Nothing to show yet, the sync after the batch brings it
+            }
+        }
+
+        if (!items.empty()) {
+            // Appended, like YouTube does
+            auto state = std::make_shared<YouTubeAPI::LoadingState>();
+            state->InsertPos = -1;
+            state->ReferenceName = Config::Current().UserYTName + L" - " + Find(x.second.front()->PlaylistId)->Title;
+            YouTubeAPI::GetExistingTrackIds(playlist, state);
+            YouTubeAPI::AddItems(playlist, items, state);
+        }
+        playlist->EndUpdate();
+        playlist->Release();
+    }
+}
+
+void PlaylistMutations::GoOffline() {
+    if (!m_offline) {
+        DebugW(L"PlaylistMutations: offline, %u edits in the journal, retrying in %u s\n", (unsigned)m_journal.size(), m_retryDelay / 1000);
+
+        // The replay rate counts from when the connection is back
+        m_replayed = 0;
+        m_started = GetTickCount64() + m_retryDelay;
+    }
+    m_offline = true;
+
+    if (m_retryPending)
+        return;
+
+    m_retryPending = true;
+    Timer::SingleShot(m_retryDelay, [] {
+        m_retryPending = false;
+        m_offline = false;
+        Pump();
+    });
+    m_retryDelay = (std::min)(m_retryDelay * 2, MaxRetryDelay);
+}
+
+void PlaylistMutations::BatchFinished() {
+    if (m_started == 0)
+        return;
+
+    if (m_added > 0 || m_removed > 0 || m_failed > 0)
+        Config::SaveExtendedConfig();
+
+    // Videos added without a cached title show up through a sync of just their playlists
+    for (const auto &x : m_resync) {
+        MonitorEngine::SyncPlaylist(x);
+    }
+    m_resync.clear();
+
+    const ULONGLONG now = GetTickCount64();
+    const ULONGLONG ms = now > m_started ? now - m_started : 0;
+    if (m_replayed > 0)
+        m_replayRate = m_replayed * 1000.0 / (double)(std::max)(ms, 1ULL);
+
+    DebugW(L"PlaylistMutations: %d added, %d removed, %d failed, %d replayed (%.1f/s), %d round trips in %llu ms, %u left in the journal\n",
+           m_added, m_removed, m_failed, m_replayed, m_replayed > 0 ? m_replayRate : 0.0, m_roundTrips, ms, (unsigned)m_journal.size());
+    m_started = 0;
+    m_added = m_removed = m_failed = m_replayed = m_roundTrips = 0;
+}
+
+std::wstring PlaylistMutations::JournalFile() {
+    return Config::PluginConfigFolder() + L"Config\\Mutations.journal";
+}
+
+bool PlaylistMutations::OpenJournal() {
+    if (m_journalFile)
+        return true;
+
+    CreateDirectory((Config::PluginConfigFolder() + L"Config\\").c_str(), NULL);
+    if (_wfopen_s(&m_journalFile, JournalFile().c_str(), L"ab") != 0) {
+        m_journalFile = nullptr;
+        DebugW(L"PlaylistMutations: can't open the journal\n");
+        return false;
+    }
+    return true;
+}
+
+void PlaylistMutations::Record(const Op &op) {
+    m_journal.emplace(op.Seq, op);
+    if (!OpenJournal())
+        return;
+
+    // Flushed right away, a crash after this doesn't lose the edit
+    WriteEntry(m_journalFile, op.Type == Add, op.Seq, op.PlaylistId, op.VideoId);
+    fflush(m_journalFile);
+}
+
+void PlaylistMutations::Complete(uint64_t seq) {
+    if (m_journal.erase(seq) == 0)
+        return;
+
+    if (m_journal.empty()) {
+        // Nothing pending, the file starts over
+        if (m_journalFile) {
+            fclose(m_journalFile);
+            m_journalFile = nullptr;
+        }
+        DeleteFile(JournalFile().c_str());
+        return;
+    }
+
+    if (OpenJournal()) {
+        fprintf(m_journalFile, "= %llu\n", (unsigned long long)seq);
+        fflush(m_journalFile);
+    }
+}
+
+void PlaylistMutations::LoadJournal() {
+    FILE *file = nullptr;
+    if (_wfopen_s(&file, JournalFile().c_str(), L"rb") != 0)
+        return;
+
+    char line[512];
+    while (fgets(line, sizeof(line), file)) {
+        if (!strchr(line, '\n'))
+            continue; // Cut short by a crash
+
+        char *end = nullptr;
+        const uint64_t seq = strtoull(line + 1, &end, 10);
+        m_nextSeq = (std::max)(m_nextSeq, seq);
+        if (line[0] == '=') {
+            m_journal.erase(seq);
+            continue;
+        }
+        if (line[0] != '+' && line[0] != '-')
+            continue;
+
+        char *playlistId = end + strspn(end, " ");
+        char *videoId = playlistId + strcspn(playlistId, " ");
+        if (!*videoId)
+            continue;
+        *videoId++ = 0;
+        videoId[strcspn(videoId, " \r\n")] = 0;
+        if (!*playlistId || !*videoId)
+            continue;
+
+        Op op = { line[0] == '+' ? Add : Remove, Tools::ToWString(playlistId), Tools::ToWString(videoId), seq, true };
+        m_journal[seq] = op;
+    }
+    fclose(file);
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <windows.h>
+#include <cstdio>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include "Config.h"
+#include "ResponseDecoder.h"
+
+// Add to / Remove from the user's YouTube playlists. Requests are queued and
+// sent up to MaxInFlight at a time. A batch ends when the queue drains: the
+// config is saved once and only the AIMP playlists that need it are resynced.
+//
+// Removes use the playlistItem IDs cached while syncing (Playlist::ItemIds) and
+// cost one round trip, the lookup is only made for videos not seen by a sync.
+//
+// Every edit goes to a journal (Config\Mutations.journal) first and is applied
+// to Playlist::Items and the AIMP playlist right away. Without a connection or
+// sign in, and on auth or server errors, the ops stay queued and are retried
+// later, entries left over from an earlier session are replayed by Start().
+// Replaying is safe: a replayed add looks the video up before adding it again,
+// and removing a video that's already gone succeeds. An edit that undoes one
+// still waiting in the queue drops both. A rejected edit is undone locally.
+//
+// Everything except the HTTP callbacks runs on the main thread.
+class PlaylistMutations {
+public:
+    enum Kind {
+        Add,
+        Remove
+    };
+
+    static void Start(); // Replays the journal, after the extended config is loaded
+    static void Stop();
+    static void Resume(); // Signed in or back online, retries right away
+
+    static void Enqueue(Kind kind, const std::wstring &playlistId, const std::wstring &videoId); // YouTube playlist ID
+
+    // Videos with a remove still pending, a sync mustn't bring them back
+    static void PendingRemoves(const std::wstring &playlistId, std::unordered_set<std::wstring> &out);
+
+    static inline size_t Pending() { return m_queue.size() + m_inFlight; }
+    static inline size_t JournalDepth() { return m_journal.size(); }
+    static inline double ReplayRate() { return m_replayRate; } // Ops/s of the last batch that replayed anything
+
+private:
+    struct Op {
+        Kind Type;
+        std::wstring PlaylistId;
+        std::wstring VideoId;
+        uint64_t Seq;  // Journal entry
+        bool Replayed; // May have reached YouTube already
+    };
+
+    enum Result {
+        Sent,
+        Rejected, // By the API, won't work when retried
+        Offline   // No response, auth or server trouble, retried later
+    };
+
+    static void Pump();
+    static void Send(const Op &op);
+    static void Insert(const Op &op);
+    static void Lookup(const Op &op);
+    static void Delete(const Op &op, const std::wstring &itemId, bool cached);
+    static void Done(const Op &op, Result result, const std::wstring &itemId);
+    static void NotStarted(const Op &op); // The request couldn't be sent
+    static void ApplyRows(const std::vector<Op> &ops, bool undo);
+    static void BatchFinished();
+    static void GoOffline();
+
+    static Result Classify(unsigned char *data, ResponseDecoder::Response &r, bool expectBody); // In the HTTP callback
+
+    static void Record(const Op &op);
+    static void Complete(uint64_t seq);
+    static bool OpenJournal();
+    static void LoadJournal();
+    static std::wstring JournalFile();
+
+    static Config::Playlist *Find(const std::wstring &playlistId);
+    static inline std::wstring Target(const Op &op) { return op.PlaylistId + L"/" + op.VideoId; }
+
+    static std::deque<Op> m_queue;
+    static std::unordered_map<std::wstring, int> m_queued; // Target() -> ops of it in the queue
+    static std::unordered_set<std::wstring> m_busy; // Target() of ops in flight, one at a time per video and playlist
+    static std::vector<Op> m_local; // Queued since the last Pump(), their rows aren't changed yet
+    static std::unordered_set<std::wstring> m_resync; // AIMP playlist IDs to resync when the batch ends
+    static std::map<uint64_t, Op> m_journal; // Not completed yet, by sequence number
+    static FILE *m_journalFile;
+    static uint64_t m_nextSeq;
+    static int m_inFlight;
+    static bool m_pumpPosted;
+    static bool m_offline;
+    static bool m_retryPending;
+    static unsigned int m_retryDelay;
+    static ULONGLONG m_started;
+    static int m_added;
+    static int m_removed;
+    static int m_failed;
+    static int m_replayed;
+    static int m_roundTrips;
+    static double m_replayRate;
+
+    PlaylistMutations();
+    PlaylistMutations(const PlaylistMutations &);
+    PlaylistMutations &operator=(const PlaylistMutations &);
+};
@@ -0,0 +1,111 @@
+#include "PlaylistSnapshot.h"
+
+#include "PlaylistIndex.h"
+#include "Tools.h"
+#include "SDK/apiFileManager.h"
+#include <cwchar>
+
+namespace {
+    const wchar_t Scheme[] = L"youtube://";
+    const size_t SchemeLength = sizeof(Scheme) / sizeof(Scheme[0]) - 1;
+
+    // Our own rows are youtube://<id>/<title>.mp4, anything else goes through TrackIdFromUrl
+    void AppendId(IAIMPString *url, std::vector<wchar_t> &out) {
+        const wchar_t *s = url->GetData();
+        const size_t length = (size_t)url->GetLength();
+        if (length > SchemeLength && wmemcmp(s, Scheme, SchemeLength) == 0) {
+            const wchar_t *id = s + SchemeLength;
+            const wchar_t *end = wmemchr(id, L'/', length - SchemeLength);
+            out.insert(out.end(), id, end ? end : s + length);
+            return;
+        }
+
+        if (!wcsstr(s, L"youtu") && !wcsstr(s, L"googleapis.com"))
+            return; // Local files and other streams
+
+        std::wstring id = Tools::TrackIdFromUrl(s);
+        out.insert(out.end(), id.begin(), id.end());
+    }
+}
+
+PlaylistSnapshot::PlaylistSnapshot(IAIMPPlaylist *pl, int fields) : m_playlist(pl), m_selectedCount(0) {
+    m_playlist->AddRef();
+
+    const int n = m_playlist->GetItemCount();
+    m_items.reserve(n);
+    m_ids.reserve(size_t(n) * 11); // YouTube IDs are 11 characters
+    m_idStart.reserve(n + 1);
+    m_idStart.push_back(0);
+    m_selected.assign((n + 31) / 32, 0);
+    if (fields & Durations)
+        m_durations.assign(n, 0);
+
+    for (int i = 0; i < n; ++i) {
+        IAIMPPlaylistItem *item = nullptr;
+        if (FAILED(m_playlist->GetItem(i, IID_IAIMPPlaylistItem, reinterpret_cast<void **>(&item))))
+            break; // Changed under us, keep what was read
+
+        const int row = (int)m_items.size();
+        m_items.push_back(item);
+
+        IAIMPString *url = nullptr;
+        if (SUCCEEDED(item->GetValueAsObject(AIMP_PLAYLISTITEM_PROPID_FILENAME, IID_IAIMPString, reinterpret_cast<void **>(&url)))) {
+            AppendId(url, m_ids);
+            url->Release();
+        }
+        m_idStart.push_back((uint32_t)m_ids.size());
+
+        if (fields & Selection) {
+            int selected = 0;
+            if (SUCCEEDED(item->GetValueAsInt32(AIMP_PLAYLISTITEM_PROPID_SELECTED, &selected)) && selected) {
+                m_selected[row >> 5] |= 1u << (row & 31);
+                m_selectedCount++;
+            }
+        }
+
+        if (fields & Durations) {
+            IAIMPFileInfo *finfo = nullptr;
+            if (SUCCEEDED(item->GetValueAsObject(AIMP_PLAYLISTITEM_PROPID_FILEINFO, IID_IAIMPFileInfo, reinterpret_cast<void **>(&finfo)))) {
+                finfo->GetValueAsFloat(AIMP_FILEINFO_PROPID_DURATION, &m_durations[row]);
+                finfo->Release();
+            }
+        }
+    }
+}
+
+PlaylistSnapshot::~PlaylistSnapshot() {
+    for (auto item : m_items) {
+        if (item)
+            item->Release();
+    }
+
+    m_playlist->Release();
+}
+
+void PlaylistSnapshot::Delete(int row) {
+    m_deleted.push_back(row);
+}
+
+int PlaylistSnapshot::Commit() {
+    if (m_deleted.empty())
+        return 0;
+
+    int deleted = 0;
+    PlaylistIndex::Mutation mutation(m_playlist);
+    m_playlist->BeginUpdate();
+    for (int row : m_deleted) {
+        IAIMPPlaylistItem *&item = m_items[row];
+        if (!item)
+            continue; // Queued twice
+
+        PlaylistIndex::Removed(m_playlist, item, IdString(row));
+        if (SUCCEEDED(m_playlist->Delete(item)))
+            deleted++;
+        item->Release();
+        item = nullptr;
+    }
+    m_playlist->EndUpdate();
+
+    m_deleted.clear();
+    return deleted;
+}
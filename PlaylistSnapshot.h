@@ -0,0 +1,56 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "SDK/apiPlaylists.h"
+
+// A playlist read once into flat arrays, one slot per row: the video ID (all of
+// them packed into one buffer, empty for rows that aren't YouTube videos), the
+// selection bit, the duration and the item. Loops then run over the arrays
+// instead of calling GetItem and the item properties on every visit.
+// Deletions are queued and applied together by Commit(), in one
+// BeginUpdate/EndUpdate.
+//
+// Rows are read by FILENAME only, the file info is fetched just for Durations.
+class PlaylistSnapshot {
+public:
+    enum Fields {
+        Ids       = 0, // Always read
+        Selection = 1,
+        Durations = 2
+    };
+
+    explicit PlaylistSnapshot(IAIMPPlaylist *pl, int fields = Ids);
+    ~PlaylistSnapshot();
+
+    inline int Count() const { return (int)m_items.size(); }
+    inline IAIMPPlaylist *Playlist() const { return m_playlist; }
+
+    inline bool HasId(int row) const { return m_idStart[row + 1] != m_idStart[row]; }
+    inline const wchar_t *Id(int row) const { return m_ids.data() + m_idStart[row]; } // Not null-terminated
+    inline size_t IdLength(int row) const { return m_idStart[row + 1] - m_idStart[row]; }
+    inline std::wstring IdString(int row) const { return std::wstring(Id(row), IdLength(row)); }
+
+    inline bool IsSelected(int row) const { return (m_selected[row >> 5] >> (row & 31)) & 1; }
+    inline double Duration(int row) const { return m_durations.empty() ? 0 : m_durations[row]; }
+    inline IAIMPPlaylistItem *Item(int row) const { return m_items[row]; } // Owned by the snapshot, nullptr once deleted
+
+    inline int SelectedCount() const { return m_selectedCount; }
+
+    void Delete(int row); // Queued until Commit()
+    int Commit();         // Returns the number of rows deleted
+
+private:
+    IAIMPPlaylist *m_playlist;
+    std::vector<IAIMPPlaylistItem *> m_items;
+    std::vector<wchar_t> m_ids;
+    std::vector<uint32_t> m_idStart; // Count() + 1 offsets into m_ids
+    std::vector<uint32_t> m_selected; // Bits
+    std::vector<double> m_durations;
+    std::vector<int> m_deleted;
+    int m_selectedCount;
+
+    PlaylistSnapshot(const PlaylistSnapshot &);
+    PlaylistSnapshot &operator=(const PlaylistSnapshot &);
+};
@@ -0,0 +1,224 @@
+#include "PlaylistValidator.h"
+
+#include "AIMPYouTube.h"
+#include "AimpHTTP.h"
+#include "Config.h"
+#include "MainThread.h"
+#include "MonitorEngine.h"
+#include "ResponseDecoder.h"
+#include "PlaylistIndex.h"
+#include "Timer.h"
+#include "Tools.h"
+#include "SDK/apiPlaylists.h"
+#include <ctime>
+#include <memory>
+#include <algorithm>
+
+static const unsigned int TickInterval = 60 * 1000; // ms between two due checks
+static const size_t       BatchSize    = 50;        // Max IDs per videos?id= request
+static const int          RequestCost  = 1;         // Quota units per videos.list call
+
+UINT_PTR PlaylistValidator::m_timer = 0;
+bool PlaylistValidator::m_running = false;
+int PlaylistValidator::m_generation = 0;
+ULONGLONG PlaylistValidator::m_started = 0;
+std::wstring PlaylistValidator::m_region;
+std::vector<std::wstring> PlaylistValidator::m_playlists;
+std::vector<std::wstring> PlaylistValidator::m_ids;
+size_t PlaylistValidator::m_next = 0;
+int PlaylistValidator::m_requests = 0;
+int PlaylistValidator::m_failed = 0;
+std::unordered_set<std::wstring> PlaylistValidator::m_unavailable;
+
+namespace {
+    bool IsUnavailable(const ResponseDecoder::Item &item, const std::wstring &region) {
+        if (item.PrivacyStatus == L"private")
+            return true;
+
+        if (item.UploadStatus == L"deleted" || item.UploadStatus == L"failed" || item.UploadStatus == L"rejected")
+            return true;
+
+        if (!region.empty()) {
+            const auto &allowed = item.RegionAllowed;
+            const auto &blocked = item.RegionBlocked;
+            if (!allowed.empty() && std::find(allowed.begin(), allowed.end(), region) == allowed.end())
+                return true;
+            if (std::find(blocked.begin(), blocked.end(), region) != blocked.end())
+                return true;
+        }
+        return false;
+    }
+}
+
+void PlaylistValidator::Start() {
+    if (m_timer)
+        return;
+
+    m_timer = Timer::Schedule(TickInterval, Tick);
+}
+
+void PlaylistValidator::Stop() {
+    if (m_timer) {
+        Timer::Cancel(m_timer);
+        m_timer = 0;
+    }
+
+    m_generation++;
+    m_running = false;
+    m_playlists.clear();
+    m_ids.clear();
+    m_unavailable.clear();
+}
+
+void PlaylistValidator::Tick() {
+    const int hours = Config::Current().ValidateEveryHours;
+    if (m_running || hours <= 0 || !Config::IsLoaded())
+        return;
+
+    if (std::time(nullptr) >= Config::GetInt64(L"LastValidation") + int64_t(hours) * 3600)
+        Run();
+}
+
+void PlaylistValidator::Run() {
+    if (m_running || !Config::IsLoaded())
+        return;
+
+    m_playlists.clear();
+    m_ids.clear();
+    m_unavailable.clear();
+
+    std::unordered_set<std::wstring> seen;
+    Plugin::instance()->ForAllPlaylists([&seen](IAIMPPlaylist *pl, const std::wstring &) {
+        std::unordered_set<std::wstring> ids;
+        PlaylistIndex::Ids(pl, ids);
+        if (!ids.empty()) {
+            m_playlists.push_back(Plugin::instance()->PlaylistId(pl));
+            seen.insert(ids.begin(), ids.end());
+        }
+
+        pl->Release();
+    });
+    m_ids.assign(seen.begin(), seen.end());
+
+    if (m_ids.empty()) {
+        Config::SetInt64(L"LastValidation", std::time(nullptr));
+        return;
+    }
+
+    wchar_t region[10] = { 0 };
+    m_region = GetLocaleInfoW(LOCALE_USER_DEFAULT, LOCALE_SISO3166CTRYNAME, region, 10) > 0 ? region : L"";
+
+    m_running = true;
+    m_started = GetTickCount64();
+    m_next = 0;
+    m_requests = 0;
+    m_failed = 0;
+    SendBatch();
+}
+
+void PlaylistValidator::SendBatch() {
+    if (m_next >= m_ids.size()) {
+        Finish();
+        return;
+    }
+
+    auto ids = std::make_shared<std::vector<std::wstring>>();
+    std::wstring allIds;
+    for (; m_next < m_ids.size() && ids->size() < BatchSize; ++m_next) {
+        if (!allIds.empty())
+            allIds += L',';
+        allIds += m_ids[m_next];
+        ids->push_back(m_ids[m_next]);
+    }
+
+    std::wstring reqUrl(L"https://www.googleapis.com/youtube/v3/videos?part=status%2CcontentDetails&fields=items(id%2Cstatus(privacyStatus%2CuploadStatus)%2CcontentDetails%2FregionRestriction)&id=" + allIds);
+    reqUrl += L"&key=" TEXT(APP_KEY);
+    if (Plugin::instance()->isConnected())
+        reqUrl += L"\r\nAuthorization: Bearer " + Plugin::instance()->getAccessToken();
+
+    m_requests++;
+    const int generation = m_generation;
+    const std::wstring region = m_region;
+    bool started = AimpHTTP::Get(reqUrl, [ids, generation, region](unsigned char *data, int size) {
+        auto gone = std::make_shared<std::vector<std::wstring>>();
+        ResponseDecoder::Response r;
+        const bool ok = !AimpHTTP::Failed() && ResponseDecoder::Decode(reinterpret_cast<char *>(data), r) && r.Valid && !r.Error;
+        if (ok) {
+            std::unordered_set<std::wstring> returned;
+            for (const auto &x : r.Items) {
+                returned.insert(x.Id);
+                if (IsUnavailable(x, region))
+                    gone->push_back(x.Id);
+            }
+            // Deleted videos aren't in the response at all
+            for (const auto &id : *ids) {
+                if (returned.find(id) == returned.end())
+                    gone->push_back(id);
+            }
+        }
+
+        MainThread::Post([generation, ok, gone] {
+            if (generation != m_generation)
+                return;
+
+            if (ok) {
+                m_unavailable.insert(gone->begin(), gone->end());
+            } else {
+                m_failed++; // Nothing in this batch is judged on a failed request
+            }
+            SendBatch();
+        });
+    });
+
+    if (!started) {
+        // The rest would go the same way, the next tick tries again
+        m_failed++;
+        Finish();
+    }
+}
+
+void PlaylistValidator::Finish() {
+    const bool remove = Config::Current().ValidateRemove;
+    int removed = 0, unchecked = 0;
+
+    if (!m_unavailable.empty()) {
+        for (const auto &playlistId : m_playlists) {
+            if (MonitorEngine::IsSyncing(playlistId))
+                continue; // Next run, deleting rows would shift its inserts
+
+            IAIMPPlaylist *pl = Plugin::instance()->GetPlaylistById(playlistId);
+            if (!pl)
+                continue;
+
+            PlaylistIndex::Mutation mutation(pl);
+            pl->BeginUpdate();
+            for (const auto &id : m_unavailable) {
+                if (remove) {
+                    removed += PlaylistIndex::Delete(pl, id);
+                    continue;
+                }
+
+                PlaylistIndex::ForRows(pl, id, [&unchecked](IAIMPPlaylistItem *item) {
+                    int playing = 0;
+                    if (SUCCEEDED(item->GetValueAsInt32(AIMP_PLAYLISTITEM_PROPID_PLAYINGSWITCH, &playing)) && playing) {
+                        item->SetValueAsInt32(AIMP_PLAYLISTITEM_PROPID_PLAYINGSWITCH, 0);
+                        unchecked++;
+                    }
+                });
+            }
+            pl->EndUpdate();
+            pl->Release();
+        }
+    }
+
+    DebugW(L"PlaylistValidator: %u videos in %u playlists checked in %llu ms, %u unavailable, %d removed, %d unchecked, %d requests failed, %d quota units\n",
+           (unsigned)m_ids.size(), (unsigned)m_playlists.size(), GetTickCount64() - m_started, (unsigned)m_unavailable.size(), removed, unchecked, m_failed, m_requests * RequestCost);
+
+    if (!m_failed)
+        Config::SetInt64(L"LastValidation", std::time(nullptr));
+
+    m_running = false;
+    m_playlists.clear();
+    m_ids.clear();
+    m_unavailable.clear();
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <windows.h>
+#include <string>
+#include <vector>
+#include <unordered_set>
+
+// Periodically checks that the youtube:// items of every loaded playlist are
+// still playable. Videos that were deleted, made private, rejected or are
+// blocked in the user's region get unchecked, or removed with
+// Settings::ValidateRemove, before playback runs into them one youtube-dl
+// timeout at a time.
+//
+// Each video is checked once per run however many playlists hold it, 50 per
+// videos?id= request, one request at a time. Playlists are only touched after
+// the last response, in one BeginUpdate/EndUpdate each.
+class PlaylistValidator {
+public:
+    static void Start();
+    static void Stop();
+
+    static void Run(); // Starts a run right away, no-op while one is going
+
+    static inline bool IsRunning() { return m_running; }
+
+private:
+    static void Tick();
+    static void SendBatch();
+    static void Finish();
+
+    static UINT_PTR m_timer;
+    static bool m_running;
+    static int m_generation; // Responses from a stopped run are dropped
+    static ULONGLONG m_started;
+
+    static std::wstring m_region;
+    static std::vector<std::wstring> m_playlists; // AIMP playlist IDs
+    static std::vector<std::wstring> m_ids;
+    static size_t m_next;
+    static int m_requests;
+    static int m_failed;
+    static std::unordered_set<std::wstring> m_unavailable;
+
+    PlaylistValidator();
+    PlaylistValidator(const PlaylistValidator &);
+    PlaylistValidator &operator=(const PlaylistValidator &);
+};
@@ -0,0 +1,362 @@
+#include "PushSubscriber.h"
+
+#include "AIMPYouTube.h"
+#include "AimpHTTP.h"
+#include "MainThread.h"
+#include "MonitorEngine.h"
+#include "PlaylistIndex.h"
+#include "TcpServer.h"
+#include "Timer.h"
+#include "Tools.h"
+#include "YouTubeAPI.h"
+#include "SDK/apiPlaylists.h"
+#include <bcrypt.h>
+#include <ctime>
+#include <cstdio>
+#include <memory>
+#include <algorithm>
+
+#pragma comment(lib, "Bcrypt.lib")
+
+static const wchar_t      HubUrl[]      = L"https://pubsubhubbub.appspot.com/subscribe";
+static const int          LeaseSeconds  = 5 * 24 * 60 * 60;
+static const unsigned int RenewInterval = 2 * 24 * 60 * 60 * 1000; // ms, well within the lease
+static const size_t       SecretBytes   = 20;
+
+TcpServer *PushSubscriber::m_server = nullptr;
+UINT_PTR PushSubscriber::m_renewTimer = 0;
+std::mutex PushSubscriber::m_channelsMutex;
+std::unordered_set<std::string> PushSubscriber::m_channels;
+std::string PushSubscriber::m_secret;
+
+namespace {
+    std::string Between(const std::string &s, const std::string &open, const std::string &close, size_t from = 0) {
+        size_t start = s.find(open, from);
+        if (start == std::string::npos)
+            return std::string();
+
+        start += open.size();
+        size_t end = s.find(close, start);
+        if (end == std::string::npos)
+            return std::string();
+
+        return s.substr(start, end - start);
+    }
+
+    std::string QueryValue(const std::string &query, const std::string &key) {
+        size_t pos = 0;
+        while ((pos = query.find(key + "=", pos)) != std::string::npos) {
+            if (pos == 0 || query[pos - 1] == '&' || query[pos - 1] == '?') {
+                pos += key.size() + 1;
+                return Tools::UrlDecode(query.substr(pos, query.find('&', pos) - pos));
+            }
+            pos += key.size();
+        }
+        return std::string();
+    }
+
+    std::string HttpResponse(const char *status, const std::string &body = std::string()) {
+        char header[128];
+        sprintf_s(header, "HTTP/1.1 %s\r\nContent-Type: text/plain\r\nContent-Length: %u\r\nConnection: close\r\n\r\n", status, (unsigned)body.size());
+        return header + body;
+    }
+
+    std::string Hex(const unsigned char *data, size_t length) {
+        static const char digits[] = "0123456789abcdef";
+        std::string hex;
+        hex.reserve(length * 2);
+        for (size_t i = 0; i < length; ++i) {
+            hex += digits[data[i] >> 4];
+            hex += digits[data[i] & 0x0F];
+        }
+        return hex;
+    }
+
+    // Lowercase hex, empty if CNG fails
+    std::string HmacSha1(const std::string &key, const std::string &data) {
+        std::string result;
+        BCRYPT_ALG_HANDLE alg = nullptr;
+        if (!BCRYPT_SUCCESS(BCryptOpenAlgorithmProvider(&alg, BCRYPT_SHA1_ALGORITHM, nullptr, BCRYPT_ALG_HANDLE_HMAC_FLAG)))
+            return result;
+
+        BCRYPT_HASH_HANDLE hash = nullptr;
+        unsigned char digest[20];
+        if (BCRYPT_SUCCESS(BCryptCreateHash(alg, &hash, nullptr, 0, (PUCHAR)key.data(), (ULONG)key.size(), 0))) {
+            if (BCRYPT_SUCCESS(BCryptHashData(hash, (PUCHAR)data.data(), (ULONG)data.size(), 0)) &&
+                BCRYPT_SUCCESS(BCryptFinishHash(hash, digest, sizeof(digest), 0))) {
+                result = Hex(digest, sizeof(digest));
+            }
+            BCryptDestroyHash(hash);
+        }
+        BCryptCloseAlgorithmProvider(alg, 0);
+        return result;
+    }
+
+    // Doesn't stop at the first difference
+    bool SameDigest(const std::string &a, const std::string &b) {
+        if (a.size() != b.size() || a.empty())
+            return false;
+
+        unsigned char diff = 0;
+        for (size_t i = 0; i < a.size(); ++i) {
+            diff |= (unsigned char)(a[i] ^ b[i]);
+        }
+        return diff == 0;
+    }
+
+    std::string HeaderValue(const std::string &request, const std::string &name) { // name in lowercase
+        size_t headersEnd = request.find("\r\n\r\n");
+        std::string headers(request, 0, headersEnd);
+        for (auto &c : headers) c = (char)tolower(c);
+
+        size_t pos = headers.find("\r\n" + name + ":");
+        if (pos == std::string::npos)
+            return std::string();
+
+        pos += name.size() + 3;
+        size_t end = (std::min)(headers.find("\r\n", pos), headers.size()); // The last one has no CRLF left
+        return Tools::Trim(request.substr(pos, end - pos));
+    }
+
+    int64_t ParseTimestamp(const std::string &s) {
+        // 2018-01-31T12:34:56+00:00, the hub always sends UTC
+        std::tm t = {};
+        if (sscanf_s(s.c_str(), "%d-%d-%dT%d:%d:%d", &t.tm_year, &t.tm_mon, &t.tm_mday, &t.tm_hour, &t.tm_min, &t.tm_sec) != 6)
+            return 0;
+
+        t.tm_year -= 1900;
+        t.tm_mon -= 1;
+        return _mkgmtime(&t);
+    }
+}
+
+void PushSubscriber::Start() {
+    const Config::Settings &settings = Config::Current();
+    if (m_server || !settings.PushEnabled || settings.PushCallbackUrl.empty())
+        return;
+
+    // Kept across sessions, the hub signs notifications of live leases with it
+    m_secret = Tools::ToString(Config::GetString(L"PushSecret"));
+    if (m_secret.empty()) {
+        unsigned char random[SecretBytes];
+        if (!BCRYPT_SUCCESS(BCryptGenRandom(nullptr, random, sizeof(random), BCRYPT_USE_SYSTEM_PREFERRED_RNG)))
+            return;
+
+        m_secret = Hex(random, sizeof(random));
+        Config::SetString(L"PushSecret", Tools::ToWString(m_secret));
+    }
+
+    m_server = new TcpServer(settings.PushPort, [](TcpServer *, char *request, std::string &response) -> bool {
+        return OnRequest(request, response);
+    });
+    m_server->setDeleteOnFinish(false);
+    if (!m_server->Start()) { // Port in use
+        DebugW(L"PushSubscriber: can't listen on port %d\n", settings.PushPort);
+        delete m_server;
+        m_server = nullptr;
+        return;
+    }
+
+    Subscribe();
+    m_renewTimer = Timer::Schedule(RenewInterval, Subscribe);
+}
+
+void PushSubscriber::Stop() {
+    if (m_renewTimer) {
+        Timer::Cancel(m_renewTimer);
+        m_renewTimer = 0;
+    }
+    if (m_server) {
+        m_server->Stop(); // Waits for the server thread, it only posts to this one
+        delete m_server;
+        m_server = nullptr;
+    }
+
+    // Leases simply run out, no need to unsubscribe
+    std::lock_guard<std::mutex> lock(m_channelsMutex);
+    m_channels.clear();
+}
+
+std::wstring PushSubscriber::ChannelId(const std::wstring &monitorUrl) {
+    size_t pos;
+    if (monitorUrl.find(L"/youtube/v3/channels?") != std::wstring::npos && (pos = monitorUrl.find(L"&id=UC")) != std::wstring::npos) {
+        pos += 4;
+        return monitorUrl.substr(pos, monitorUrl.find(L'&', pos) - pos);
+    }
+    if (monitorUrl.find(L"playlistItems?") != std::wstring::npos && (pos = monitorUrl.find(L"playlistId=UU")) != std::wstring::npos) {
+        // Uploads playlist of UCxxx is UUxxx
+        pos += 13;
+        return L"UC" + monitorUrl.substr(pos, monitorUrl.find(L'&', pos) - pos);
+    }
+    return std::wstring(); // forUsername= sources need a lookup first, they're left to the sweeps
+}
+
+void PushSubscriber::Subscribe() {
+    const Config::Settings &settings = Config::Current();
+    if (!m_server || settings.PushCallbackUrl.empty())
+        return;
+
+    Config::WaitUntilLoaded();
+
+    std::unordered_set<std::string> channels;
+    for (const auto &x : Config::MonitorUrls) {
+        std::wstring id = ChannelId(x.URL);
+        if (!id.empty())
+            channels.insert(Tools::ToString(id));
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_channelsMutex);
+        m_channels = channels;
+    }
+
+    std::string callback = Tools::ToString(Tools::UrlEncode(settings.PushCallbackUrl));
+    for (const auto &id : channels) {
+        std::string topic = Tools::ToString(Tools::UrlEncode(L"https://www.youtube.com/xml/feeds/videos.xml?channel_id=" + Tools::ToWString(id)));
+        std::string post("hub.callback=" + callback + "&hub.topic=" + topic + "&hub.verify=async&hub.mode=subscribe&hub.lease_seconds=" + std::to_string(LeaseSeconds) +
+                         "&hub.secret=" + m_secret);
+
+        AimpHTTP::Post(std::wstring(HubUrl) + L"\r\nContent-Type: application/x-www-form-urlencoded", post, nullptr);
+    }
+    DebugW(L"PushSubscriber: subscribed to %u channels\n", (unsigned)channels.size());
+}
+
+bool PushSubscriber::OnRequest(char *request, std::string &response) {
+    // Runs on the server thread, never returns true: the server keeps listening until Stop()
+    const ULONGLONG received = GetTickCount64();
+    std::string req(request);
+
+    size_t lineEnd = req.find("\r\n");
+    std::string line = req.substr(0, lineEnd);
+    size_t sp1 = line.find(' ');
+    size_t sp2 = line.find(' ', sp1 + 1);
+    if (sp1 == std::string::npos || sp2 == std::string::npos) {
+        response = HttpResponse("400 Bad Request");
+        return false;
+    }
+    std::string method = line.substr(0, sp1);
+    std::string target = line.substr(sp1 + 1, sp2 - sp1 - 1);
+
+    if (method == "GET") {
+        // Subscription verification, only confirm topics we asked for
+        std::string query = target.substr((std::min)(target.find('?'), target.size()));
+        std::string challenge = QueryValue(query, "hub.challenge");
+        std::string topic = QueryValue(query, "hub.topic");
+        std::string channelId = topic.substr((std::min)(topic.find("channel_id="), topic.size()));
+        if (!channelId.empty())
+            channelId = channelId.substr(11);
+
+        bool known = false;
+        {
+            std::lock_guard<std::mutex> lock(m_channelsMutex);
+            known = m_channels.find(channelId) != m_channels.end();
+        }
+        if (challenge.empty() || (!known && QueryValue(query, "hub.mode") == "subscribe")) {
+            response = HttpResponse("404 Not Found");
+        } else {
+            response = HttpResponse("200 OK", challenge);
+        }
+        return false;
+    }
+
+    if (method == "POST") {
+        size_t bodyStart = req.find("\r\n\r\n");
+        std::string body = bodyStart != std::string::npos ? req.substr(bodyStart + 4) : std::string();
+
+        // X-Hub-Signature: sha1=<HMAC of the body with hub.secret>. Anything else is
+        // acknowledged (the hub doesn't retry a 2xx) but dropped, it'd only cost quota.
+        std::string signature = HeaderValue(req, "x-hub-signature");
+        response = HttpResponse("200 OK");
+        if (signature.compare(0, 5, "sha1=") != 0 || !SameDigest(signature.substr(5), HmacSha1(m_secret, body))) {
+            DebugW(L"PushSubscriber: dropped a notification with a missing or wrong signature\n");
+            return false;
+        }
+
+        // Deletions come as <at:deleted-entry>, the validator deals with those
+        std::string videoId = Between(body, "<yt:videoId>", "</yt:videoId>");
+        std::string channelId = Between(body, "<yt:channelId>", "</yt:channelId>");
+        std::string published = Between(body, "<published>", "</published>");
+
+        if (!videoId.empty() && !channelId.empty()) {
+            std::wstring wVideoId = Tools::ToWString(videoId), wChannelId = Tools::ToWString(channelId);
+            MainThread::Post([wVideoId, wChannelId, received, published] {
+                Insert(wVideoId, wChannelId, received, published);
+            });
+        }
+        return false;
+    }
+
+    response = HttpResponse("405 Method Not Allowed");
+    return false;
+}
+
+void PushSubscriber::Insert(const std::wstring &videoId, const std::wstring &channelId, ULONGLONG received, const std::string &published) {
+    if (!Plugin::instance()->core() || !Config::IsLoaded())
+        return;
+
+    if (Config::TrackExclusions.find(videoId) != Config::TrackExclusions.end())
+        return;
+
+    bool monitored = false;
+    for (const auto &x : Config::MonitorUrls) {
+        monitored |= ChannelId(x.URL) == channelId;
+    }
+    if (!monitored)
+        return;
+
+    // Signed by the hub, but the video has to really be from that channel
+    std::wstring reqUrl(L"https://www.googleapis.com/youtube/v3/videos?part=contentDetails%2Csnippet&id=" + videoId + L"&key=" TEXT(APP_KEY));
+    if (Plugin::instance()->isConnected())
+        reqUrl += L"\r\nAuthorization: Bearer " + Plugin::instance()->getAccessToken();
+
+    AimpHTTP::Get(reqUrl, [videoId, channelId, received, published](unsigned char *data, int size) {
+        ResponseDecoder::Response r;
+        if (!ResponseDecoder::Decode(reinterpret_cast<char *>(data), r) || r.Items.size() != 1 || r.Items[0].ChannelId != channelId)
+            return;
+
+        auto items = std::make_shared<std::vector<YouTubeAPI::VideoItem>>();
+        YouTubeAPI::ParseItems(r, *items);
+
+        MainThread::Run([videoId, channelId, received, published, items] {
+            if (!Plugin::instance()->core())
+                return;
+
+            int added = 0;
+            const int64_t now = std::time(nullptr);
+            for (auto &x : Config::MonitorUrls) {
+                if (ChannelId(x.URL) != channelId || MonitorEngine::IsSyncing(x.PlaylistID))
+                    continue; // A running sync picks it up anyway
+
+                IAIMPPlaylist *pl = Plugin::instance()->GetPlaylistById(x.PlaylistID, false);
+                if (!pl)
+                    continue;
+
+                auto state = std::make_shared<YouTubeAPI::LoadingState>();
+                state->ReferenceName = x.GroupName;
+                state->Flags = x.Flags;
+                YouTubeAPI::GetExistingTrackIds(pl, state);
+
+                {
+                    PlaylistIndex::Mutation mutation(pl);
+                    pl->BeginUpdate();
+                    YouTubeAPI::AddItems(pl, *items, state);
+                    pl->EndUpdate();
+                }
+                pl->Release();
+
+                if (state->AddedItems > 0) {
+                    added += state->AddedItems;
+                    x.LastChange = now;
+                    Config::MarkDirty(Config::ShardMonitors);
+                }
+            }
+
+            if (added > 0) {
+                Config::SaveExtendedConfig();
+
+                int64_t publishedAt = ParseTimestamp(published);
+                DebugW(L"PushSubscriber: %s inserted %llu ms after the notification, %lld s after publishing\n", videoId.c_str(),
+                       GetTickCount64() - received, publishedAt > 0 ? (long long)(now - publishedAt) : -1LL);
+            }
+        });
+    });
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <windows.h>
+#include <string>
+#include <mutex>
+#include <unordered_set>
+
+class TcpServer;
+
+// WebSub (PubSubHubbub) subscriber for monitored channels. YouTube's hub POSTs
+// an Atom entry to PushCallbackUrl as soon as a channel uploads, the video is
+// then fetched on its own and inserted into every playlist monitoring that
+// channel, without waiting for the next sweep.
+//
+// PushCallbackUrl has to be reachable from the internet and forward to the
+// local PushPort. Subscriptions carry a hub.secret, notifications without a
+// matching X-Hub-Signature are dropped. Sweeps keep running as usual, pushes
+// only make them late less often.
+class PushSubscriber {
+public:
+    static void Start(); // No-op unless enabled in settings
+    static void Stop();
+    static void Restart() { Stop(); Start(); }
+
+    static void Subscribe(); // (Re)subscribes every monitored channel
+
+    static std::wstring ChannelId(const std::wstring &monitorUrl); // Empty if the source isn't a single channel
+
+private:
+    static bool OnRequest(char *request, std::string &response);
+    static void Insert(const std::wstring &videoId, const std::wstring &channelId, ULONGLONG received, const std::string &published);
+
+    static TcpServer *m_server;
+    static UINT_PTR m_renewTimer;
+
+    static std::mutex m_channelsMutex;
+    static std::unordered_set<std::string> m_channels; // Read from the server thread
+    static std::string m_secret; // hub.secret, set while the server isn't running
+
+    PushSubscriber();
+    PushSubscriber(const PushSubscriber &);
+    PushSubscriber &operator=(const PushSubscriber &);
+};
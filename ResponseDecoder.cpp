@@ -0,0 +1,213 @@
+#include "ResponseDecoder.h"
+
+#include "Utf.h"
+#include "Tools.h"
+#include "rapidjson/reader.h"
+#include <cstring>
+
+namespace {
+    enum Key : unsigned char {
+        KeyNone,
+        KeyElement, // Array element
+        KeyOther,
+        KeyItems,
+        KeyId,
+        KeySnippet,
+        KeyContentDetails,
+        KeyTitle,
+        KeyLocalized,
+        KeyChannelId,
+        KeyChannelTitle,
+        KeyResourceId,
+        KeyVideoId,
+        KeyThumbnails,
+        KeyHigh,
+        KeyUrl,
+        KeyDuration,
+        KeyRelatedPlaylists,
+        KeyUploads,
+        KeyNextPageToken,
+        KeyPageInfo,
+        KeyTotalResults,
+        KeyStatus,
+        KeyPrivacyStatus,
+        KeyUploadStatus,
+        KeyRegionRestriction,
+        KeyAllowed,
+        KeyBlocked,
+        KeyError,
+        KeyCode
+    };
+
+    Key Lookup(const char *s, rapidjson::SizeType len) {
+        #define KEY(name, key) if (len == sizeof(name) - 1 && memcmp(s, name, len) == 0) return key
+        switch (len) {
+            case 2:  KEY("id", KeyId); break;
+            case 3:  KEY("url", KeyUrl); break;
+            case 4:  KEY("high", KeyHigh); KEY("code", KeyCode); break;
+            case 5:  KEY("items", KeyItems); KEY("title", KeyTitle); KEY("error", KeyError); break;
+            case 6:  KEY("status", KeyStatus); break;
+            case 7:  KEY("snippet", KeySnippet); KEY("videoId", KeyVideoId); KEY("uploads", KeyUploads); KEY("allowed", KeyAllowed); KEY("blocked", KeyBlocked); break;
+            case 8:  KEY("duration", KeyDuration); KEY("pageInfo", KeyPageInfo); break;
+            case 9:  KEY("localized", KeyLocalized); KEY("channelId", KeyChannelId); break;
+            case 10: KEY("resourceId", KeyResourceId); KEY("thumbnails", KeyThumbnails); break;
+            case 12: KEY("channelTitle", KeyChannelTitle); KEY("totalResults", KeyTotalResults); KEY("uploadStatus", KeyUploadStatus); break;
+            case 13: KEY("nextPageToken", KeyNextPageToken); KEY("privacyStatus", KeyPrivacyStatus); break;
+            case 14: KEY("contentDetails", KeyContentDetails); break;
+            case 16: KEY("relatedPlaylists", KeyRelatedPlaylists); break;
+            case 17: KEY("regionRestriction", KeyRegionRestriction); break;
+        }
+        #undef KEY
+        return KeyOther;
+    }
+
+    inline void Assign(std::wstring &out, const char *s, rapidjson::SizeType len) {
+        Utf::ToUtf16(s, len, out);
+    }
+}
+
+class ResponseDecoder::Handler : public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, Handler> {
+public:
+    explicit Handler(Response &response) : m_response(response), m_depth(0), m_hasRoot(false) {}
+
+    bool StartObject() {
+        if (m_depth == 0) {
+            m_response.Valid = true;
+        } else if (m_depth == 2 && m_path[0] == KeyItems && m_path[1] == KeyElement) {
+            m_response.Items.emplace_back();
+        }
+        return Push(KeyNone);
+    }
+    bool EndObject(rapidjson::SizeType) { m_depth--; return true; }
+    bool StartArray() { return Push(KeyElement); }
+    bool EndArray(rapidjson::SizeType) { m_depth--; return true; }
+
+    bool Key(const char *s, rapidjson::SizeType len, bool) {
+        m_path[m_depth - 1] = Lookup(s, len);
+        if (m_depth == 1 && m_path[0] == KeyError)
+            m_response.Error = true;
+        return true;
+    }
+
+    bool Uint(unsigned value) {
+        if (m_depth == 2 && m_path[0] == KeyPageInfo && m_path[1] == KeyTotalResults)
+            m_response.TotalResults = (int)value;
+        else if (m_depth == 2 && m_path[0] == KeyError && m_path[1] == KeyCode)
+            m_response.ErrorCode = (int)value;
+        return true;
+    }
+
+    bool String(const char *s, rapidjson::SizeType len, bool) {
+        if (m_depth == 1 && m_path[0] == KeyNextPageToken) {
+            Assign(m_response.NextPageToken, s, len);
+            return true;
+        }
+
+        int base = 0;
+        Item *item = Current(base);
+        if (!item)
+            return true;
+
+        const unsigned char *p = m_path + base;
+        switch (m_depth - base) {
+            case 1:
+                if (p[0] == KeyId) Assign(item->Id, s, len);
+            break;
+            case 2:
+                if (p[0] == KeySnippet) {
+                    switch (p[1]) {
+                        case KeyTitle:        Assign(item->Title, s, len); item->HasTitle = true; break;
+                        case KeyChannelId:    Assign(item->ChannelId, s, len); break;
+                        case KeyChannelTitle: Assign(item->ChannelTitle, s, len); break;
+                    }
+                } else if (p[0] == KeyContentDetails) {
+                    if (p[1] == KeyVideoId) {
+                        Assign(item->VideoId, s, len);
+                    } else if (p[1] == KeyDuration) {
+                        item->Duration = Tools::ParseDuration(s, len);
+                    }
+                } else if (p[0] == KeyStatus) {
+                    if (p[1] == KeyPrivacyStatus) {
+                        Assign(item->PrivacyStatus, s, len);
+                    } else if (p[1] == KeyUploadStatus) {
+                        Assign(item->UploadStatus, s, len);
+                    }
+                }
+            break;
+            case 3:
+                if (p[0] == KeySnippet && p[1] == KeyResourceId && p[2] == KeyVideoId) {
+                    Assign(item->VideoId, s, len);
+                } else if (p[0] == KeySnippet && p[1] == KeyLocalized && p[2] == KeyTitle) {
+                    Assign(item->LocalizedTitle, s, len);
+                } else if (p[0] == KeyContentDetails && p[1] == KeyRelatedPlaylists && p[2] == KeyUploads) {
+                    Assign(item->Uploads, s, len);
+                }
+            break;
+            case 4:
+                if (p[0] == KeySnippet && p[1] == KeyThumbnails && p[2] == KeyHigh && p[3] == KeyUrl) {
+                    Assign(item->Artwork, s, len);
+                } else if (p[0] == KeyContentDetails && p[1] == KeyRegionRestriction && p[3] == KeyElement) {
+                    if (p[2] == KeyAllowed) {
+                        item->RegionAllowed.emplace_back();
+                        Assign(item->RegionAllowed.back(), s, len);
+                    } else if (p[2] == KeyBlocked) {
+                        item->RegionBlocked.emplace_back();
+                        Assign(item->RegionBlocked.back(), s, len);
+                    }
+                }
+            break;
+        }
+        return true;
+    }
+
+    void Finish() {
+        if (m_hasRoot && m_response.Items.empty())
+            m_response.Items.push_back(std::move(m_root));
+    }
+
+private:
+    bool Push(unsigned char key) {
+        if (m_depth == MaxDepth)
+            return false; // Nothing we read is nested this deep
+        m_path[m_depth++] = key;
+        return true;
+    }
+
+    Item *Current(int &base) {
+        if (m_depth >= 3 && m_path[0] == KeyItems && m_path[1] == KeyElement) {
+            base = 2;
+            return m_response.Items.empty() ? nullptr : &m_response.Items.back();
+        }
+        if (m_path[0] == KeySnippet || m_path[0] == KeyContentDetails || m_path[0] == KeyStatus || m_path[0] == KeyId) {
+            base = 0;
+            m_hasRoot = true;
+            return &m_root;
+        }
+        return nullptr;
+    }
+
+    static const int MaxDepth = 32;
+
+    Response &m_response;
+    unsigned char m_path[MaxDepth];
+    int m_depth;
+    Item m_root;
+    bool m_hasRoot;
+};
+
+bool ResponseDecoder::Decode(char *json, Response &response) {
+    if (!json)
+        return false;
+
+    Handler handler(response);
+    rapidjson::InsituStringStream stream(json);
+    rapidjson::Reader reader;
+    reader.Parse<rapidjson::kParseInsituFlag>(stream, handler);
+    if (reader.HasParseError()) {
+        response.Valid = false;
+        return false;
+    }
+
+    handler.Finish();
+    return response.Valid;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// Streaming decoder for the YouTube Data API responses the plugin consumes
+// (playlistItems, videos, channels, playlists). The response buffer is parsed
+// in place with a SAX reader, only the fields below are kept, and each one is
+// transcoded straight from the buffer into its record. No DOM is built.
+class ResponseDecoder {
+public:
+    struct Item {
+        std::wstring Id;             // items[].id: video, playlist item, channel or playlist ID
+        std::wstring VideoId;        // snippet.resourceId.videoId or contentDetails.videoId
+        std::wstring Title;          // snippet.title
+        std::wstring LocalizedTitle; // snippet.localized.title
+        std::wstring ChannelId;      // snippet.channelId
+        std::wstring ChannelTitle;   // snippet.channelTitle
+        std::wstring Artwork;        // snippet.thumbnails.high.url
+        std::wstring Uploads;        // contentDetails.relatedPlaylists.uploads
+        int64_t Duration;            // contentDetails.duration in s, -1 if not present
+        std::wstring PrivacyStatus;  // status.privacyStatus
+        std::wstring UploadStatus;   // status.uploadStatus
+        std::vector<std::wstring> RegionAllowed; // contentDetails.regionRestriction.allowed
+        std::vector<std::wstring> RegionBlocked; // contentDetails.regionRestriction.blocked
+        bool HasTitle;
+
+        Item() : Duration(-1), HasTitle(false) {}
+    };
+
+    struct Response {
+        bool Valid; // The response parsed and is an object
+        bool Error; // It has an "error" member
+        int ErrorCode; // error.code, the HTTP status, 0 if not present
+        std::wstring NextPageToken;
+        int TotalResults; // pageInfo.totalResults, -1 if not present
+        std::vector<Item> Items; // An object with a snippet but no items array decodes as one item
+
+        Response() : Valid(false), Error(false), ErrorCode(0), TotalResults(-1) {}
+    };
+
+    // Destroys the contents of json, which has to be null-terminated
+    static bool Decode(char *json, Response &response);
+
+private:
+    class Handler;
+
+    ResponseDecoder();
+    ResponseDecoder(const ResponseDecoder &);
+    ResponseDecoder &operator=(const ResponseDecoder &);
+};
@@ -4,79 +4,136 @@
 #include <process.h>
 #pragma comment(lib,"ws2_32.lib")
 
-TcpServer::TcpServer(int port, RequestFunc callback) : m_port(port), m_callback(callback), m_deleteOnFinish(true) {
+static const size_t MaxRequestSize = 64 * 1024;
+static const DWORD  RecvTimeout    = 10000; // ms
 
-}
+TcpServer::TcpServer(int port, RequestFunc callback) : m_port(port), m_callback(callback), m_deleteOnFinish(true), m_socket(INVALID_SOCKET), m_thread(0) {
 
-void TcpServer::ThreadFunc(void *arg) {
-    TcpServer *parent = static_cast<TcpServer *>(arg);
-    if (!parent)
-        return;
+}
 
-    WSADATA wsa;
-    if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) {
-        OutputDebugString(L"WSAStartup failed\n");
-        if (parent->m_deleteOnFinish)
-            delete parent;
-        return;
-    }
-    SOCKET s;
-    if ((s = socket(AF_INET, SOCK_STREAM, 0)) == INVALID_SOCKET) {
-        OutputDebugString(L"Could not create socket\n");
-        if (parent->m_deleteOnFinish)
-            delete parent;
-        return;
-    }
+bool TcpServer::ReadRequest(uintptr_t socket, std::string &request) {
+    // Headers first, then as much body as Content-Length says
+    char buffer[2048];
+    size_t expected = 0;
+    size_t headerEnd = std::string::npos;
+    while (request.size() < MaxRequestSize) {
+        int received = recv(socket, buffer, sizeof(buffer), 0);
+        if (received <= 0)
+            break;
 
-    struct sockaddr_in server, client;
-    server.sin_family = AF_INET;
-    server.sin_addr.s_addr = INADDR_ANY;
-    server.sin_port = htons(parent->m_port);
+        request.append(buffer, received);
+        if (headerEnd == std::string::npos && (headerEnd = request.find("\r\n\r\n")) != std::string::npos) {
+            headerEnd += 4;
+            expected = headerEnd;
 
-    if (bind(s, (struct sockaddr *)&server, sizeof(server)) == SOCKET_ERROR) {
-        OutputDebugString(L"bind failed\n");
-        if (parent->m_deleteOnFinish)
-            delete parent;
-        return;
+            std::string headers(request, 0, headerEnd);
+            for (auto &c : headers) c = (char)tolower(c);
+            size_t pos = headers.find("\r\ncontent-length:");
+            if (pos != std::string::npos)
+                expected += strtoul(headers.c_str() + pos + 17, nullptr, 10);
+        }
+        if (headerEnd != std::string::npos && request.size() >= expected)
+            break;
     }
+    return !request.empty();
+}
 
-    listen(s, 3);
+unsigned __stdcall TcpServer::ThreadFunc(void *arg) {
+    TcpServer *parent = static_cast<TcpServer *>(arg);
+    SOCKET s = parent->m_socket;
 
+    struct sockaddr_in client;
     int c = sizeof(struct sockaddr_in);
     do {
         SOCKET new_socket = accept(s, (struct sockaddr *)&client, &c);
         if (new_socket == INVALID_SOCKET) {
-            OutputDebugString(L"accept failed\n");
-            if (parent->m_deleteOnFinish)
-                delete parent;
-            return;
+            OutputDebugString(L"accept failed\n"); // Or Stop() closed the socket
+            break;
         }
-        char request[2048];
-        memset(request, 0, sizeof(request));
+        // A client that never sends anything mustn't keep Stop() waiting
+        DWORD timeout = RecvTimeout;
+        setsockopt(new_socket, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char *>(&timeout), sizeof(timeout));
 
-        recv(new_socket, request, sizeof(request), 0);
+        std::string request;
+        ReadRequest(new_socket, request);
 
         std::string response;
-        if (parent->m_callback(parent, request, response)) {
-            if (!response.empty()) {
-                send(new_socket, response.c_str(), response.size(), 0);
-            }
-            closesocket(new_socket);
-            closesocket(s);
-            WSACleanup();
-            if (parent->m_deleteOnFinish) {
-                delete parent;
-            }
-            break;
+        bool finished = parent->m_callback(parent, &request[0], response);
+        if (!response.empty()) {
+            send(new_socket, response.c_str(), response.size(), 0);
         }
+        closesocket(new_socket);
+
+        if (finished)
+            break;
     } while (true);
+
+    SOCKET listener = parent->m_socket.exchange(INVALID_SOCKET);
+    if (listener != INVALID_SOCKET)
+        closesocket(listener);
+    WSACleanup();
+
+    if (parent->m_deleteOnFinish)
+        delete parent;
+    return 0;
+}
+
+void TcpServer::Stop() {
+    SOCKET listener = m_socket.exchange(INVALID_SOCKET);
+    if (listener != INVALID_SOCKET)
+        closesocket(listener);
+
+    if (m_thread) {
+        WaitForSingleObject(reinterpret_cast<HANDLE>(m_thread), INFINITE);
+        CloseHandle(reinterpret_cast<HANDLE>(m_thread));
+        m_thread = 0;
+    }
 }
 
 bool TcpServer::Start() {
-    HANDLE hThread = (HANDLE)_beginthread(ThreadFunc, 0, this);
-    return hThread != INVALID_HANDLE_VALUE;
+    WSADATA wsa;
+    if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) {
+        OutputDebugString(L"WSAStartup failed\n");
+        return false;
+    }
+    SOCKET s;
+    if ((s = socket(AF_INET, SOCK_STREAM, 0)) == INVALID_SOCKET) {
+        OutputDebugString(L"Could not create socket\n");
+        WSACleanup();
+        return false;
+    }
+
+    struct sockaddr_in server;
+    server.sin_family = AF_INET;
+    server.sin_addr.s_addr = INADDR_ANY;
+    server.sin_port = htons(m_port);
+
+    if (bind(s, (struct sockaddr *)&server, sizeof(server)) == SOCKET_ERROR || listen(s, 3) == SOCKET_ERROR) {
+        OutputDebugString(L"bind failed\n");
+        closesocket(s);
+        WSACleanup();
+        return false;
+    }
+    m_socket = s;
+
+    // The thread may delete this as soon as it runs, decide about the handle first
+    const bool detach = m_deleteOnFinish;
+    uintptr_t thread = _beginthreadex(nullptr, 0, ThreadFunc, this, 0, nullptr);
+    if (!thread) {
+        m_socket = INVALID_SOCKET;
+        closesocket(s);
+        WSACleanup();
+        return false;
+    }
+    if (detach) {
+        CloseHandle(reinterpret_cast<HANDLE>(thread));
+    } else {
+        m_thread = thread;
+    }
+    return true;
 }
 
 TcpServer::~TcpServer() {
-
+    if (m_thread)
+        Stop();
 }
@@ -1,6 +1,9 @@
 #pragma once
 
 #include <functional>
+#include <string>
+#include <atomic>
+#include <cstdint>
 
 class TcpServer {
     typedef std::function<bool(TcpServer *, char *, std::string &)> RequestFunc;
@@ -9,15 +12,19 @@ public:
     TcpServer(int port, RequestFunc callback);
     ~TcpServer();
 
-    bool Start();
+    bool Start(); // Returns once the port is bound and listening, false if it can't be
+    void Stop(); // Closes the listening socket and waits for the server thread, unless it deletes itself. Not from the callback
 
     inline void setDeleteOnFinish(bool v) { m_deleteOnFinish = v; }
 
 private:
-    static void ThreadFunc(void *arg);
+    static unsigned __stdcall ThreadFunc(void *arg);
+
+    static bool ReadRequest(uintptr_t socket, std::string &request);
 
     bool m_deleteOnFinish;
     int m_port;
+    std::atomic<uintptr_t> m_socket; // Closed by whichever of Stop() and the server thread gets to it first
+    uintptr_t m_thread; // Only kept to be joined when not deleting itself
     RequestFunc m_callback;
 };
-
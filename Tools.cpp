@@ -1,34 +1,84 @@
 #include "Tools.h"
+#include "TrackInfoStore.h"
+#include "Utf.h"
 
 #include <windows.h>
 #include <locale>
 #include <sstream>
 #include <iomanip>
-#include <codecvt>
 #include <cctype>
 #include <string>
 #include <algorithm>
 
-static std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>> wStrConverter;
+static const int64_t MaxDurationValue = 1000000000000LL; // Cap for a number and the total, keeps the math far from overflowing
+
+int64_t Tools::ParseDuration(const char *s, size_t length) {
+    if (!s || length < 3 || s[0] != 'P')
+        return -1;
+
+    int64_t total = 0;
+    bool time = false, any = false;
+    for (size_t i = 1; i < length;) {
+        if (s[i] == 'T') {
+            if (time)
+                return -1;
+            time = true;
+            ++i;
+            continue;
+        }
+
+        int64_t value = 0;
+        size_t start = i;
+        while (i < length && unsigned(s[i] - '0') < 10) {
+            value = value * 10 + (s[i++] - '0');
+            if (value > MaxDurationValue)
+                return -1;
+        }
+        if (i < length && (s[i] == '.' || s[i] == ',')) {
+            while (++i < length && unsigned(s[i] - '0') < 10) {} // Fractions only show up on seconds, drop them
+        }
+        if (i == start || i == length)
+            return -1;
+
+        switch (s[i++]) {
+            case 'W': if (time) return -1; total += value * 7 * 24 * 3600; break;
+            case 'D': if (time) return -1; total += value * 24 * 3600; break;
+            case 'H': if (!time) return -1; total += value * 3600; break;
+            case 'M': if (!time) return -1; total += value * 60; break; // Months never appear in video durations
+            case 'S': if (!time) return -1; total += value; break;
+            default:  return -1;
+        }
+        if (total > MaxDurationValue)
+            return -1;
+        any = true;
+    }
+    return any ? total : -1;
+}
 
 std::wstring Tools::ToWString(const std::string &string) {
-    return wStrConverter.from_bytes(string);
+    std::wstring result;
+    Utf::ToUtf16(string.data(), string.size(), result);
+    return result;
 }
 
 std::wstring Tools::ToWString(const char *string) {
-    return wStrConverter.from_bytes(string);
+    std::wstring result;
+    if (string)
+        Utf::ToUtf16(string, strlen(string), result);
+    return result;
 }
 
 std::wstring Tools::ToWString(const rapidjson::Value &val) {
-    if (val.IsString() && val.GetStringLength() > 0) {
-        const char *ptr = val.GetString();
-        return wStrConverter.from_bytes(ptr, ptr + val.GetStringLength());
-    }
-    return std::wstring();
+    std::wstring result;
+    if (val.IsString() && val.GetStringLength() > 0)
+        Utf::ToUtf16(val.GetString(), val.GetStringLength(), result);
+    return result;
 }
 
 std::string Tools::ToString(const std::wstring &string) {
-    return wStrConverter.to_bytes(string);
+    std::string result;
+    Utf::ToUtf8(string.data(), string.size(), result);
+    return result;
 }
 
 void Tools::OutputLastError() {
@@ -64,27 +114,27 @@ std::wstring Tools::UrlEncode(const std::wstring &url) {
 
 char letter_to_hex(char ch) {
     return isdigit(ch) ? ch - '0' : tolower(ch) - 'a' + 10;
-}
-std::string Tools::UrlDecode(const std::string &input) {
-    std::string decoded;
-    auto it = input.begin();
-    auto out = std::back_inserter(decoded);
-    while (it != input.end()) {
-        if (*it == '%') {
-            ++it;
-            auto v0 = letter_to_hex(*it);
-            ++it;
-            auto v1 = letter_to_hex(*it);
-            ++it;
-            *out++ = 0x10 * v0 + v1;
-        } else if (*it == '+') {
-            *out++ = ' ';
-            ++it;
-        } else {
-            *out++ = *it++;
-        }
-    }
-    return decoded;
+}
+std::string Tools::UrlDecode(const std::string &input) {
+    std::string decoded;
+    auto it = input.begin();
+    auto out = std::back_inserter(decoded);
+    while (it != input.end()) {
+        if (*it == '%') {
+            ++it;
+            auto v0 = letter_to_hex(*it);
+            ++it;
+            auto v1 = letter_to_hex(*it);
+            ++it;
+            *out++ = 0x10 * v0 + v1;
+        } else if (*it == '+') {
+            *out++ = ' ';
+            ++it;
+        } else {
+            *out++ = *it++;
+        }
+    }
+    return decoded;
 }
 std::wstring Tools::TrackIdFromUrl(const std::wstring &url) {
     std::wstring id;
@@ -159,17 +209,18 @@ std::string Tools::Trim(const std::string &s) {
     return (wsback <= wsfront ? std::string() : std::string(wsfront, wsback));
 }
 
-Config::TrackInfo *Tools::TrackInfo(const std::wstring &id) {
+Config::TrackInfoHandle Tools::TrackInfo(const std::wstring &id) {
     if (!id.empty()) {
-        if (Config::TrackInfos.find(id) == Config::TrackInfos.end()) {
-            if (!Config::ResolveTrackInfo(id))
-                return nullptr;
-        }
-        return &Config::TrackInfos[id];
+        Config::WaitUntilLoaded();
+        if (auto ti = Config::TrackInfos.Get(id))
+            return ti;
+
+        if (Config::ResolveTrackInfo(id))
+            return Config::TrackInfos.Get(id);
     }
     return nullptr;
 }
 
-Config::TrackInfo *Tools::TrackInfo(IAIMPString *FileName) {
+Config::TrackInfoHandle Tools::TrackInfo(IAIMPString *FileName) {
     return TrackInfo(Tools::TrackIdFromUrl(FileName->GetData()));
 }
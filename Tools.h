@@ -20,9 +20,11 @@ struct Tools {
     static void SplitString(const std::string &string, const std::string &delimiter, std::function<void(const std::string &token)> callback);
     static  std::string Trim(const std::string &s);
 
+    static int64_t ParseDuration(const char *iso8601, size_t length); // P[nW][nD][T[nH][nM][nS]] in s, -1 if malformed
+
     static std::wstring TrackIdFromUrl(const std::wstring &);
-    static Config::TrackInfo *TrackInfo(const std::wstring &id);
-    static Config::TrackInfo *TrackInfo(IAIMPString *FileName);
+    static Config::TrackInfoHandle TrackInfo(const std::wstring &id);
+    static Config::TrackInfoHandle TrackInfo(IAIMPString *FileName);
 
     static std::wstring UrlEncode(const std::wstring &);
     static std::string UrlDecode(const std::string &input);
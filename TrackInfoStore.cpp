@@ -0,0 +1,127 @@
+#include "TrackInfoStore.h"
+
+#include <ctime>
+
+Config::TrackInfoStore::TrackInfoStore() : m_size(0) {
+    for (auto &shard : m_shards) {
+        InitializeSRWLock(&shard.Lock);
+    }
+}
+
+Config::TrackInfoHandle Config::TrackInfoStore::Get(const std::wstring &id) {
+    TrackInfoHandle result;
+    Shard &shard = ShardFor(id);
+    AcquireSRWLockShared(&shard.Lock);
+    auto it = shard.Items.find(id);
+    if (it != shard.Items.end()) {
+        it->second.LastAccess.store(std::time(nullptr), std::memory_order_relaxed);
+        it->second.Referenced.store(true, std::memory_order_relaxed);
+        result = it->second.Info;
+    }
+    ReleaseSRWLockShared(&shard.Lock);
+    return result;
+}
+
+Config::TrackInfoHandle Config::TrackInfoStore::Peek(const std::wstring &id) const {
+    TrackInfoHandle result;
+    const Shard &shard = ShardFor(id);
+    AcquireSRWLockShared(&shard.Lock);
+    auto it = shard.Items.find(id);
+    if (it != shard.Items.end()) {
+        result = it->second.Info;
+    }
+    ReleaseSRWLockShared(&shard.Lock);
+    return result;
+}
+
+void Config::TrackInfoStore::Put(const TrackInfo &info) {
+    Insert(info, std::time(nullptr), true);
+}
+
+void Config::TrackInfoStore::Restore(const TrackInfo &info, int64_t lastAccess) {
+    Insert(info, lastAccess, false);
+}
+
+void Config::TrackInfoStore::Insert(const TrackInfo &info, int64_t lastAccess, bool referenced) {
+    auto handle = std::make_shared<const TrackInfo>(info);
+
+    Shard &shard = ShardFor(info.Id);
+    AcquireSRWLockExclusive(&shard.Lock);
+    auto it = shard.Items.find(info.Id);
+    if (it != shard.Items.end()) {
+        it->second.Info = handle;
+        it->second.LastAccess = lastAccess;
+        it->second.Referenced = referenced;
+    } else {
+        shard.Items.emplace(std::piecewise_construct, std::forward_as_tuple(info.Id), std::forward_as_tuple(handle, lastAccess, referenced));
+        m_size++;
+    }
+    ReleaseSRWLockExclusive(&shard.Lock);
+}
+
+bool Config::TrackInfoStore::Erase(const std::wstring &id) {
+    Shard &shard = ShardFor(id);
+    AcquireSRWLockExclusive(&shard.Lock);
+    bool erased = shard.Items.erase(id) > 0;
+    if (erased)
+        m_size--;
+    ReleaseSRWLockExclusive(&shard.Lock);
+    return erased;
+}
+
+void Config::TrackInfoStore::Clear() {
+    for (auto &shard : m_shards) {
+        AcquireSRWLockExclusive(&shard.Lock);
+        m_size -= shard.Items.size();
+        shard.Items.clear();
+        ReleaseSRWLockExclusive(&shard.Lock);
+    }
+}
+
+std::vector<std::wstring> Config::TrackInfoStore::Keys() const {
+    std::vector<std::wstring> keys;
+    keys.reserve(Size());
+    for (const auto &shard : m_shards) {
+        AcquireSRWLockShared(&shard.Lock);
+        for (const auto &x : shard.Items) {
+            keys.push_back(x.first);
+        }
+        ReleaseSRWLockShared(&shard.Lock);
+    }
+    return keys;
+}
+
+void Config::TrackInfoStore::Snapshot(std::vector<std::pair<TrackInfoHandle, int64_t>> &out) const {
+    out.reserve(out.size() + Size());
+    for (const auto &shard : m_shards) {
+        AcquireSRWLockShared(&shard.Lock);
+        for (const auto &x : shard.Items) {
+            out.emplace_back(x.second.Info, x.second.LastAccess.load(std::memory_order_relaxed));
+        }
+        ReleaseSRWLockShared(&shard.Lock);
+    }
+}
+
+int64_t Config::TrackInfoStore::LastAccess(const std::wstring &id) const {
+    int64_t result = -1;
+    const Shard &shard = ShardFor(id);
+    AcquireSRWLockShared(&shard.Lock);
+    auto it = shard.Items.find(id);
+    if (it != shard.Items.end()) {
+        result = it->second.LastAccess.load(std::memory_order_relaxed);
+    }
+    ReleaseSRWLockShared(&shard.Lock);
+    return result;
+}
+
+bool Config::TrackInfoStore::ClearReferenced(const std::wstring &id) {
+    bool result = false;
+    Shard &shard = ShardFor(id);
+    AcquireSRWLockShared(&shard.Lock);
+    auto it = shard.Items.find(id);
+    if (it != shard.Items.end()) {
+        result = it->second.Referenced.exchange(false, std::memory_order_relaxed);
+    }
+    ReleaseSRWLockShared(&shard.Lock);
+    return result;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "Config.h"
+#include <windows.h>
+
+// Thread-safe home of Config::TrackInfos. Entries are split over a fixed number
+// of shards, each behind its own SRW lock. Stored infos are immutable: updates
+// publish a new copy, so a handle returned by Get() stays valid and unchanged
+// for as long as the caller keeps it.
+class Config::TrackInfoStore {
+public:
+    TrackInfoStore();
+
+    // Returns nullptr if unknown. Get() also marks the entry as used for CacheEvictor.
+    TrackInfoHandle Get(const std::wstring &id);
+    TrackInfoHandle Peek(const std::wstring &id) const;
+    bool Contains(const std::wstring &id) const { return Peek(id) != nullptr; }
+
+    void Put(const TrackInfo &info);
+    void Restore(const TrackInfo &info, int64_t lastAccess); // From the cache file, not referenced yet
+    bool Erase(const std::wstring &id);
+    void Clear();
+
+    // Copies the current info, lets func modify the copy and publishes it
+    template <typename Func>
+    bool Update(const std::wstring &id, Func func) {
+        Shard &shard = ShardFor(id);
+        AcquireSRWLockExclusive(&shard.Lock);
+        auto it = shard.Items.find(id);
+        bool found = it != shard.Items.end();
+        if (found) {
+            auto copy = std::make_shared<TrackInfo>(*it->second.Info);
+            func(*copy);
+            it->second.Info = copy;
+        }
+        ReleaseSRWLockExclusive(&shard.Lock);
+        return found;
+    }
+
+    inline size_t Size() const { return m_size.load(std::memory_order_relaxed); }
+    std::vector<std::wstring> Keys() const;
+    void Snapshot(std::vector<std::pair<TrackInfoHandle, int64_t>> &out) const; // Infos with their last access time
+
+    // CLOCK support, see CacheEvictor
+    int64_t LastAccess(const std::wstring &id) const; // -1 if unknown
+    bool ClearReferenced(const std::wstring &id);    // Returns the previous reference bit
+
+private:
+    static const size_t ShardCount = 16;
+
+    struct Entry {
+        TrackInfoHandle Info;
+        std::atomic<int64_t> LastAccess;
+        std::atomic<bool> Referenced;
+
+        Entry(TrackInfoHandle info, int64_t lastAccess, bool referenced) : Info(info), LastAccess(lastAccess), Referenced(referenced) {}
+    };
+
+    struct Shard {
+        mutable SRWLOCK Lock;
+        std::unordered_map<std::wstring, Entry> Items;
+    };
+
+    inline Shard &ShardFor(const std::wstring &id) { return m_shards[std::hash<std::wstring>()(id) % ShardCount]; }
+    inline const Shard &ShardFor(const std::wstring &id) const { return m_shards[std::hash<std::wstring>()(id) % ShardCount]; }
+
+    void Insert(const TrackInfo &info, int64_t lastAccess, bool referenced);
+
+    Shard m_shards[ShardCount];
+    std::atomic<size_t> m_size;
+
+    TrackInfoStore(const TrackInfoStore &);
+    TrackInfoStore &operator=(const TrackInfoStore &);
+};
@@ -0,0 +1,199 @@
+#include "Utf.h"
+
+#include <cstdint>
+
+#if defined(_M_IX86) || defined(_M_X64)
+#include <intrin.h>
+#include <immintrin.h>
+#define UTF_SIMD
+#endif
+
+static const wchar_t Replacement = 0xFFFD;
+
+namespace {
+#ifdef UTF_SIMD
+    bool HasAvx2() {
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7)
+            return false;
+
+        __cpuid(info, 1);
+        const bool osxsave = (info[2] & (1 << 27)) != 0;
+        const bool avx = (info[2] & (1 << 28)) != 0;
+        if (!osxsave || !avx || (_xgetbv(0) & 6) != 6)
+            return false; // The OS doesn't save the YMM registers
+
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+    }
+
+    const bool Avx2 = HasAvx2();
+
+    // Each returns how many leading ASCII bytes it converted, stopping at the first block with a non-ASCII byte
+    size_t AsciiToUtf16Sse2(const char *in, size_t length, wchar_t *out) {
+        const __m128i zero = _mm_setzero_si128();
+        size_t i = 0;
+        for (; i + 16 <= length; i += 16) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+            if (_mm_movemask_epi8(v))
+                break;
+
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), _mm_unpacklo_epi8(v, zero));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i + 8), _mm_unpackhi_epi8(v, zero));
+        }
+        return i;
+    }
+
+    size_t AsciiToUtf16Avx2(const char *in, size_t length, wchar_t *out) {
+        size_t i = 0;
+        for (; i + 32 <= length; i += 32) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + i));
+            if (_mm256_movemask_epi8(v))
+                break;
+
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), _mm256_cvtepu8_epi16(_mm256_castsi256_si128(v)));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i + 16), _mm256_cvtepu8_epi16(_mm256_extracti128_si256(v, 1)));
+        }
+        return i;
+    }
+
+    size_t AsciiToUtf8Sse2(const wchar_t *in, size_t length, char *out) {
+        const __m128i mask = _mm_set1_epi16((short)0xFF80);
+        const __m128i zero = _mm_setzero_si128();
+        size_t i = 0;
+        for (; i + 16 <= length; i += 16) {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i + 8));
+            __m128i high = _mm_and_si128(_mm_or_si128(a, b), mask);
+            if (_mm_movemask_epi8(_mm_cmpeq_epi16(high, zero)) != 0xFFFF)
+                break;
+
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), _mm_packus_epi16(a, b));
+        }
+        return i;
+    }
+#endif
+
+    inline bool IsContinuation(unsigned char c) { return (c & 0xC0) == 0x80; }
+}
+
+size_t Utf::ToUtf16(const char *in, size_t length, wchar_t *out) {
+    const unsigned char *s = reinterpret_cast<const unsigned char *>(in);
+    size_t i = 0, o = 0;
+    while (i < length) {
+#ifdef UTF_SIMD
+        if (length - i >= 16) {
+            size_t n = Avx2 ? AsciiToUtf16Avx2(in + i, length - i, out + o) : 0;
+            n += AsciiToUtf16Sse2(in + i + n, length - i - n, out + o + n);
+            i += n;
+            o += n;
+        }
+#endif
+        // Scalar until the text looks like a long ASCII run again, or the end
+        size_t asciiRun = 0;
+        while (i < length) {
+            const unsigned char c = s[i];
+            if (c < 0x80) {
+                out[o++] = c;
+                i++;
+                if (++asciiRun >= 16 && i + 16 <= length)
+                    break; // Back to the vector loop
+                continue;
+            }
+            asciiRun = 0;
+
+            uint32_t cp;
+            size_t n;
+            if (c >= 0xC2 && c <= 0xDF) {
+                cp = c & 0x1F; n = 2;
+            } else if (c >= 0xE0 && c <= 0xEF) {
+                cp = c & 0x0F; n = 3;
+            } else if (c >= 0xF0 && c <= 0xF4) {
+                cp = c & 0x07; n = 4;
+            } else {
+                out[o++] = Replacement; // Stray continuation byte, overlong lead or 0xF5+
+                i++;
+                continue;
+            }
+
+            size_t k = 1;
+            for (; k < n && i + k < length && IsContinuation(s[i + k]); ++k) {
+                cp = (cp << 6) | (s[i + k] & 0x3F);
+            }
+            if (k < n ||
+                (n == 3 && (cp < 0x800 || (cp >= 0xD800 && cp <= 0xDFFF))) ||
+                (n == 4 && (cp < 0x10000 || cp > 0x10FFFF))) {
+                out[o++] = Replacement; // Truncated, overlong, surrogate or out of range
+                i += k;
+                continue;
+            }
+            i += n;
+
+            if (cp >= 0x10000) {
+                cp -= 0x10000;
+                out[o++] = wchar_t(0xD800 + (cp >> 10));
+                out[o++] = wchar_t(0xDC00 + (cp & 0x3FF));
+            } else {
+                out[o++] = wchar_t(cp);
+            }
+        }
+    }
+    return o;
+}
+
+size_t Utf::ToUtf8(const wchar_t *in, size_t length, char *out) {
+    unsigned char *d = reinterpret_cast<unsigned char *>(out);
+    size_t i = 0, o = 0;
+    while (i < length) {
+#ifdef UTF_SIMD
+        if (length - i >= 16) {
+            size_t n = AsciiToUtf8Sse2(in + i, length - i, out + o);
+            i += n;
+            o += n;
+        }
+#endif
+        size_t asciiRun = 0;
+        while (i < length) {
+            uint32_t cp = uint16_t(in[i++]);
+            if (cp < 0x80) {
+                d[o++] = (unsigned char)cp;
+                if (++asciiRun >= 16 && i + 16 <= length)
+                    break;
+                continue;
+            }
+            asciiRun = 0;
+
+            if (cp >= 0xD800 && cp <= 0xDBFF && i < length && uint16_t(in[i]) >= 0xDC00 && uint16_t(in[i]) <= 0xDFFF) {
+                cp = 0x10000 + ((cp - 0xD800) << 10) + (uint16_t(in[i++]) - 0xDC00);
+            } else if (cp >= 0xD800 && cp <= 0xDFFF) {
+                cp = Replacement; // Unpaired surrogate
+            }
+
+            if (cp < 0x800) {
+                d[o++] = (unsigned char)(0xC0 | (cp >> 6));
+                d[o++] = (unsigned char)(0x80 | (cp & 0x3F));
+            } else if (cp < 0x10000) {
+                d[o++] = (unsigned char)(0xE0 | (cp >> 12));
+                d[o++] = (unsigned char)(0x80 | ((cp >> 6) & 0x3F));
+                d[o++] = (unsigned char)(0x80 | (cp & 0x3F));
+            } else {
+                d[o++] = (unsigned char)(0xF0 | (cp >> 18));
+                d[o++] = (unsigned char)(0x80 | ((cp >> 12) & 0x3F));
+                d[o++] = (unsigned char)(0x80 | ((cp >> 6) & 0x3F));
+                d[o++] = (unsigned char)(0x80 | (cp & 0x3F));
+            }
+        }
+    }
+    return o;
+}
+
+void Utf::ToUtf16(const char *in, size_t length, std::wstring &out) {
+    out.resize(MaxUtf16Length(length));
+    out.resize(length ? ToUtf16(in, length, &out[0]) : 0);
+}
+
+void Utf::ToUtf8(const wchar_t *in, size_t length, std::string &out) {
+    out.resize(MaxUtf8Length(length));
+    out.resize(length ? ToUtf8(in, length, &out[0]) : 0);
+}
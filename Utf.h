@@ -0,0 +1,28 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+// UTF-8 <-> UTF-16 conversion. Runs of ASCII (IDs, URLs, most titles) are
+// converted 16 or 32 characters at a time with SSE2/AVX2, everything else goes
+// through a validating scalar decoder. Malformed input becomes U+FFFD instead of
+// throwing. No shared state, safe to call from any thread.
+class Utf {
+public:
+    // Output buffer sizes that are always large enough
+    static inline size_t MaxUtf16Length(size_t utf8Length) { return utf8Length; }
+    static inline size_t MaxUtf8Length(size_t utf16Length) { return utf16Length * 3; }
+
+    // Return the number of code units written to out
+    static size_t ToUtf16(const char *in, size_t length, wchar_t *out);
+    static size_t ToUtf8(const wchar_t *in, size_t length, char *out);
+
+    // Sizes out once for the worst case, then trims it
+    static void ToUtf16(const char *in, size_t length, std::wstring &out);
+    static void ToUtf8(const wchar_t *in, size_t length, std::string &out);
+
+private:
+    Utf();
+    Utf(const Utf &);
+    Utf &operator=(const Utf &);
+};
@@ -6,231 +6,580 @@
 #include "SDK/apiPlaylists.h"
 #include "AIMPString.h"
 #include "DurationResolver.h"
+#include "PlaylistIndex.h"
+#include "PlaylistMutations.h"
+#include "PlaylistSnapshot.h"
 #include "Tools.h"
+#include "TrackInfoStore.h"
 #include "Timer.h"
+#include "MainThread.h"
+#include "ResponseDecoder.h"
 #include <Strsafe.h>
 #include <string>
 #include <set>
 #include <map>
-#include <regex>
 #include <array>
 
-void YouTubeAPI::AddFromJson(IAIMPPlaylist *playlist, const rapidjson::Value &d, std::shared_ptr<LoadingState> state) {
+static const size_t DetailsBatch = 50; // IDs per videos?id= request, the API maximum
+
+namespace {
+    bool IsPlaylistItems(const std::wstring &url) {
+        return url.find(L"/playlistItems?") != std::wstring::npos;
+    }
+
+    std::wstring WithParam(std::wstring url, const std::wstring &key, const std::wstring &value) {
+        size_t pos = url.find(L"?" + key + L"=");
+        if (pos == std::wstring::npos)
+            pos = url.find(L"&" + key + L"=");
+        if (pos == std::wstring::npos)
+            return url + L"&" + key + L"=" + value;
+
+        pos += key.size() + 2;
+        size_t end = url.find(L'&', pos);
+        return url.replace(pos, end == std::wstring::npos ? std::wstring::npos : end - pos, value);
+    }
+
+    // First phase of a two-phase sync, about 30 bytes per item instead of a few kB
+    std::wstring IdsOnlyUrl(const std::wstring &url) {
+        return WithParam(WithParam(url, L"part", L"contentDetails"), L"fields", L"items%2FcontentDetails%2FvideoId%2CnextPageToken%2CpageInfo%2FtotalResults");
+    }
+
+    // The user playlist url lists, nullptr for anything else
+    Config::Playlist *UserPlaylist(const std::wstring &url) {
+        if (!IsPlaylistItems(url))
+            return nullptr;
+
+        size_t pos = url.find(L"playlistId=");
+        if (pos == std::wstring::npos)
+            return nullptr;
+
+        pos += 11;
+        const std::wstring id(url, pos, url.find(L'&', pos) == std::wstring::npos ? std::wstring::npos : url.find(L'&', pos) - pos);
+        for (auto &x : Config::UserPlaylists) {
+            if (x.ID == id)
+                return &x;
+        }
+        return nullptr;
+    }
+
+    // Syncs of a user playlist also bring the playlistItem IDs, removes then skip their lookup
+    std::wstring WithItemIds(const std::wstring &url) {
+        size_t pos = url.find(L"&fields=");
+        if (pos == std::wstring::npos || url.find(L"items%2Fid%2C", pos) != std::wstring::npos)
+            return url;
+
+        return std::wstring(url).insert(pos + 8, L"items%2Fid%2C");
+    }
+
+    std::wstring RequestUrl(const std::wstring &url, const YouTubeAPI::LoadingState &state) {
+        std::wstring reqUrl(state.IdsFirst && IsPlaylistItems(url) ? IdsOnlyUrl(url) : url);
+        if (UserPlaylist(url))
+            reqUrl = WithItemIds(reqUrl);
+        if (reqUrl.find(L'?') == std::wstring::npos) {
+            reqUrl += L'?';
+        } else {
+            reqUrl += L'&';
+        }
+        reqUrl += L"key=" TEXT(APP_KEY);
+        if (Plugin::instance()->isConnected())
+            reqUrl += L"\r\nAuthorization: Bearer " + Plugin::instance()->getAccessToken();
+
+        return reqUrl;
+    }
+
+    int PageSize(const std::wstring &url) {
+        size_t pos = url.find(L"maxResults=");
+        return pos != std::wstring::npos ? (int)wcstol(url.c_str() + pos + 11, nullptr, 10) : 5; // 5 is the API default
+    }
+}
+
+void YouTubeAPI::ParseItems(const ResponseDecoder::Response &response, std::vector<VideoItem> &items) {
+    items.reserve(items.size() + response.Items.size());
+    for (const auto &x : response.Items) {
+        if (!x.HasTitle || x.Title == L"Deleted video" || x.Title == L"Private video")
+            continue;
+
+        VideoItem v;
+        v.Id = x.VideoId.empty() ? x.Id : x.VideoId;
+        v.Title = x.Title;
+        v.ChannelTitle = x.ChannelTitle;
+        v.Artwork = x.Artwork;
+        v.Duration = (std::max)(int64_t(0), x.Duration);
+        items.push_back(std::move(v));
+    }
+}
+
+void YouTubeAPI::AddItems(IAIMPPlaylist *playlist, const std::vector<VideoItem> &items, std::shared_ptr<LoadingState> state) {
     if (!playlist || !state || !Plugin::instance()->core())
         return;
 
+    Config::WaitUntilLoaded();
+
     int insertAt = state->InsertPos;
     if (insertAt >= 0)
         insertAt += state->AdditionalPos;
 
-    IAIMPFileInfo *file_info = nullptr;
-    if (Plugin::instance()->core()->CreateObject(IID_IAIMPFileInfo, reinterpret_cast<void **>(&file_info)) == S_OK) {
-        auto processItem = [&](const std::wstring &pid, const rapidjson::Value &item, const rapidjson::Value &contentDetails) {
-            if (!item.HasMember("title"))
-                return;
+    IAIMPObjectList *run = nullptr;
+    if (FAILED(Plugin::instance()->core()->CreateObject(IID_IAIMPObjectList, reinterpret_cast<void **>(&run))))
+        return;
+    std::vector<std::wstring> runIds;
+
+    // The rows land at known positions, PlaylistIndex picks them up from there. Callers
+    // inside BeginUpdate()/EndUpdate() hold their own Mutation across EndUpdate().
+    PlaylistIndex::Mutation mutation(playlist);
+    auto indexRows = [&](int first, int count, size_t idOffset) {
+        for (int i = 0; i < count; ++i) {
+            IAIMPPlaylistItem *row = nullptr;
+            if (SUCCEEDED(playlist->GetItem(first + i, IID_IAIMPPlaylistItem, reinterpret_cast<void **>(&row)))) {
+                PlaylistIndex::Added(playlist, row, runIds[idOffset + i]);
+                row->Release();
+            }
+        }
+    };
+
+    auto advance = [&](int count) {
+        if (insertAt >= 0) {
+            insertAt += count;
+            state->InsertPos += count;
+            if (state->Flags & LoadingState::UpdateAdditionalPos)
+                state->AdditionalPos += count;
+        }
+    };
 
-            std::wstring final_title = Tools::ToWString(item["title"]);
-            if (final_title == L"Deleted video" || final_title == L"Private video")
-                return;
+    // New items between two known ones land at consecutive positions, they go in with one AddList
+    auto flush = [&] {
+        const int count = run->GetCount();
+        if (count == 0)
+            return;
 
-            std::wstring trackId;
-            if (item.HasMember("resourceId")) {
-                trackId = Tools::ToWString(item["resourceId"]["videoId"]);
-            } else {
-                trackId = pid;
-            }
-            if (state->TrackIds.find(trackId) != state->TrackIds.end()) {
-                // Already added earlier
-                if (insertAt >= 0 && !(state->Flags & LoadingState::IgnoreExistingPosition)) {
-                    insertAt++;
-                    state->InsertPos++;
-                    if (state->Flags & LoadingState::UpdateAdditionalPos)
-                        state->AdditionalPos++;
+        const DWORD flags = AIMP_PLAYLIST_ADD_FLAGS_FILEINFO | AIMP_PLAYLIST_ADD_FLAGS_NOCHECKFORMAT | AIMP_PLAYLIST_ADD_FLAGS_NOEXPAND | AIMP_PLAYLIST_ADD_FLAGS_NOTHREADING;
+        int first = insertAt >= 0 ? insertAt : playlist->GetItemCount();
+        if (SUCCEEDED(playlist->AddList(run, flags, insertAt))) {
+            indexRows(first, count, 0);
+            state->AddedItems += count;
+            advance(count);
+        } else {
+            for (int i = 0; i < count; ++i) {
+                IAIMPFileInfo *file_info = nullptr;
+                if (SUCCEEDED(run->GetObject(i, IID_IAIMPFileInfo, reinterpret_cast<void **>(&file_info)))) {
+                    first = insertAt >= 0 ? insertAt : playlist->GetItemCount();
+                    if (SUCCEEDED(playlist->Add(file_info, flags, insertAt))) {
+                        indexRows(first, 1, i);
+                        state->AddedItems++;
+                        advance(1);
+                    }
+                    file_info->Release();
                 }
-                return;
             }
+        }
+        run->Clear();
+        runIds.clear();
+    };
+
+    for (const auto &item : items) {
+        const std::wstring &trackId = item.Id;
+        if (state->TrackIds.find(trackId) != state->TrackIds.end()) {
+            // Already added earlier
+            state->KnownRun++;
+            if (insertAt >= 0 && !(state->Flags & LoadingState::IgnoreExistingPosition)) {
+                flush();
+                advance(1);
+            }
+            continue;
+        }
 
-            if (Config::TrackExclusions.find(trackId) != Config::TrackExclusions.end())
-                return; // Track excluded
+        if (Config::TrackExclusions.find(trackId) != Config::TrackExclusions.end()) {
+            state->KnownRun++;
+            continue; // Track excluded
+        }
 
-            state->TrackIds.insert(trackId);
-            if (state->PlaylistToUpdate) {
-                state->PlaylistToUpdate->Items.insert(trackId);
-            }
+        IAIMPFileInfo *file_info = nullptr;
+        if (FAILED(Plugin::instance()->core()->CreateObject(IID_IAIMPFileInfo, reinterpret_cast<void **>(&file_info))))
+            continue;
 
-            auto permalink = L"https://www.youtube.com/watch?v=" + trackId;
+        state->KnownRun = 0;
+        state->TrackIds.insert(trackId);
+        if (state->PlaylistToUpdate) {
+            state->PlaylistToUpdate->Items.insert(trackId);
+            Config::MarkPlaylistDirty(state->PlaylistToUpdate->ID);
+        }
 
-            std::wstring filename(L"youtube://");
-            filename += trackId + L"/";
-            filename += final_title;
-            filename += L".mp4";
-            file_info->SetValueAsObject(AIMP_FILEINFO_PROPID_FILENAME, AIMPString(filename));
+        auto permalink = L"https://www.youtube.com/watch?v=" + trackId;
 
-            if (!state->ReferenceName.empty()) {
-                file_info->SetValueAsObject(AIMP_FILEINFO_PROPID_ALBUM, AIMPString(state->ReferenceName));
-            }
-            if (item.HasMember("channelTitle") && (state->Flags & LoadingState::AddChannelTitle)) {
-                file_info->SetValueAsObject(AIMP_FILEINFO_PROPID_ARTIST, AIMPString(item["channelTitle"]));
-            }
-            file_info->SetValueAsObject(AIMP_FILEINFO_PROPID_URL, AIMPString(permalink));
+        std::wstring filename(L"youtube://");
+        filename += trackId + L"/";
+        filename += item.Title;
+        filename += L".mp4";
+        file_info->SetValueAsObject(AIMP_FILEINFO_PROPID_FILENAME, AIMPString(filename));
 
-            int64_t videoDuration = 0;
-            if (contentDetails.IsObject() && contentDetails.HasMember("duration")) {
-                std::wstring duration = Tools::ToWString(contentDetails["duration"]);
+        if (!state->ReferenceName.empty()) {
+            file_info->SetValueAsObject(AIMP_FILEINFO_PROPID_ALBUM, AIMPString(state->ReferenceName));
+        }
+        if (!item.ChannelTitle.empty() && (state->Flags & LoadingState::AddChannelTitle)) {
+            file_info->SetValueAsObject(AIMP_FILEINFO_PROPID_ARTIST, AIMPString(item.ChannelTitle));
+        }
+        file_info->SetValueAsObject(AIMP_FILEINFO_PROPID_URL, AIMPString(permalink));
 
-                std::wregex re(L"PT(?:([0-9]+)H)?(?:([0-9]+)M)?(?:([0-9]+)S)?");
-                std::wsmatch match;
-                if (std::regex_match(duration, match, re)) {
-                    auto h = match[1].matched ? std::stoll(match[1].str()) : 0;
-                    auto m = match[2].matched ? std::stoll(match[2].str()) : 0;
-                    auto s = match[3].matched ? std::stoll(match[3].str()) : 0;
-                    videoDuration = h * 3600 + m * 60 + s;
+        if (item.Duration > 0) {
+            file_info->SetValueAsFloat(AIMP_FILEINFO_PROPID_DURATION, item.Duration);
+        }
 
-                    file_info->SetValueAsFloat(AIMP_FILEINFO_PROPID_DURATION, videoDuration);
-                }
-            }
+        AIMPString title(item.Title);
+        file_info->SetValueAsObject(AIMP_FILEINFO_PROPID_TITLE, title);
 
-            AIMPString title(final_title);
-            file_info->SetValueAsObject(AIMP_FILEINFO_PROPID_TITLE, title);
+        Config::TrackInfos.Put(Config::TrackInfo(item.Title, trackId, permalink, item.Artwork, item.Duration));
+        if (item.Duration <= 0)
+            state->Unresolved.push_back(trackId);
 
-            std::wstring artwork;
-            if (item.HasMember("thumbnails") && item["thumbnails"].IsObject() && item["thumbnails"].HasMember("high") && item["thumbnails"]["high"].HasMember("url")) {
-                artwork = Tools::ToWString(item["thumbnails"]["high"]["url"]);
-            }
+        run->Add(file_info);
+        runIds.push_back(trackId);
+        file_info->Release();
+    }
+    flush();
+    run->Release();
+}
 
+void YouTubeAPI::LoadFromUrl(std::wstring url, IAIMPPlaylist *playlist, std::shared_ptr<LoadingState> state, std::function<void()> finishCallback) {
+    if (!playlist || !state)
+        return;
 
-            Config::TrackInfos[trackId] = Config::TrackInfo(final_title, trackId, permalink, artwork, videoDuration);
+    bool started = AimpHTTP::Get(RequestUrl(url, *state), [playlist, state, finishCallback, url](unsigned char *data, int size) {
+        auto r = std::make_shared<ResponseDecoder::Response>();
+        ResponseDecoder::Decode(reinterpret_cast<char *>(data), *r);
 
-            const DWORD flags = AIMP_PLAYLIST_ADD_FLAGS_FILEINFO | AIMP_PLAYLIST_ADD_FLAGS_NOCHECKFORMAT | AIMP_PLAYLIST_ADD_FLAGS_NOEXPAND | AIMP_PLAYLIST_ADD_FLAGS_NOTHREADING;
-            if (SUCCEEDED(playlist->Add(file_info, flags, insertAt))) {
-                state->AddedItems++;
-                if (insertAt >= 0) {
-                    insertAt++;
-                    state->InsertPos++;
-                    if (state->Flags & LoadingState::UpdateAdditionalPos)
-                        state->AdditionalPos++;
-                }
-            }
-        };
+        // Parsing can happen anywhere, playlist and config changes only on the main thread
+        MainThread::Run([url, playlist, state, finishCallback, r, size] {
+            state->BytesReceived += size;
+            ProcessPage(url, playlist, state, finishCallback, *r);
+        });
+    });
 
-        rapidjson::Value null;
+    if (!started) {
+        playlist->Release();
+        if (finishCallback)
+            finishCallback();
+    }
+}
 
-        if (d.IsArray()) {
-            for (auto x = d.Begin(), e = d.End(); x != e; x++) {
-                const rapidjson::Value *px = &(*x);
-                if (!px->IsObject() || !px->HasMember("snippet"))
-                    continue;
+void YouTubeAPI::ProcessPage(const std::wstring &url, IAIMPPlaylist *playlist, std::shared_ptr<LoadingState> state, std::function<void()> finishCallback, const ResponseDecoder::Response &r) {
+    if (!r.Valid || r.Error)
+        state->Failed = true;
 
-                processItem((*px).HasMember("id") ? Tools::ToWString((*px)["id"]) : L"", (*px)["snippet"], px->HasMember("contentDetails")? (*px)["contentDetails"] : null);
+    PlaylistIndex::Mutation mutation(playlist); // Outlives EndUpdate(), where AIMP notifies
+    playlist->BeginUpdate();
+    if (!r.Items.empty() && !r.Items[0].Uploads.empty()) {
+        // Channel, load its uploads playlist
+        std::wstring uploads = r.Items[0].Uploads;
+        std::wstring userName = r.Items[0].LocalizedTitle;
+        IAIMPPropertyList *plProp = nullptr;
+        if (SUCCEEDED(playlist->QueryInterface(IID_IAIMPPropertyList, reinterpret_cast<void **>(&plProp)))) {
+            bool isRenamed = true;
+            IAIMPString *str = nullptr;
+            if (SUCCEEDED(plProp->GetValueAsObject(AIMP_PLAYLIST_PROPID_NAME, IID_IAIMPString, reinterpret_cast<void **>(&str)))) {
+                isRenamed = wcscmp(L"YouTube", str->GetData());
+                str->Release();
             }
-        } else if (d.IsObject() && d.HasMember("snippet")) {
-            processItem(d.HasMember("id")? Tools::ToWString(d["id"]) : L"", d["snippet"], d.HasMember("contentDetails") ? d["contentDetails"] : null);
-        } else if (d.IsObject()) {
-            processItem(L"", d, null);
+            if (!isRenamed)
+                plProp->SetValueAsObject(AIMP_PLAYLIST_PROPID_NAME, AIMPString(userName));
+            plProp->Release();
         }
-        file_info->Release();
+        state->ReferenceName = userName;
+        playlist->EndUpdate();
+
+        // Can release the playlist right away when its request doesn't start
+        LoadFromUrl(SourceUrl(UrlPlaylist, uploads), playlist, state, finishCallback);
+        return;
+    }
+
+    if (Config::Playlist *userPlaylist = UserPlaylist(url)) {
+        for (const auto &x : r.Items) {
+            if (!x.Id.empty() && !x.VideoId.empty())
+                userPlaylist->ItemIds[x.VideoId] = x.Id;
+        }
+        PlaylistMutations::PendingRemoves(userPlaylist->ID, state->TrackIds); // Removed here, not on YouTube yet
+    }
+
+    if (state->IdsFirst && IsPlaylistItems(url)) {
+        CollectIds(r, state);
+    } else {
+        std::vector<VideoItem> items;
+        ParseItems(r, items);
+        AddItems(playlist, items, state);
+    }
+    playlist->EndUpdate();
+
+    bool processNextPage = !r.NextPageToken.empty();
+
+    if ((state->Flags & LoadingState::IgnoreNextPage) ||
+        (Config::Current().LimitUserStream && state->AddedItems + state->PendingNew >= Config::Current().LimitUserStreamValue)) {
+        processNextPage = false;
+    }
+    if (processNextPage && state->StopWhenKnown && state->KnownRun >= LoadingState::KnownRunLimit) {
+        DebugW(L"YouTubeAPI: delta sync of %s stopped after %d known items\n", url.c_str(), state->KnownRun);
+        processNextPage = false;
+    }
+
+    if (processNextPage) {
+        std::wstring next_url(url);
+        std::size_t pos = 0;
+        if ((pos = next_url.find(L"&pageToken")) != std::wstring::npos)
+            next_url = next_url.substr(0, pos);
+
+        if (state->PrefetchWindow > 0 && IsPlaylistItems(url)) {
+            FetchAhead(next_url, r, playlist, state, finishCallback);
+        } else {
+            LoadFromUrl(next_url + L"&pageToken=" + r.NextPageToken, playlist, state, finishCallback);
+        }
+    } else if (!state->PageIds.empty()) {
+        FetchDetails(playlist, state, finishCallback);
+    } else {
+        NextSource(playlist, state, finishCallback);
     }
 }
 
-void YouTubeAPI::LoadFromUrl(std::wstring url, IAIMPPlaylist *playlist, std::shared_ptr<LoadingState> state, std::function<void()> finishCallback) {
-    if (!playlist || !state)
+std::wstring YouTubeAPI::PageToken(int offset) {
+    // Base64 of a small protobuf message: field 1 = offset (varint), field 2 = 0
+    unsigned char message[16];
+    size_t n = 0;
+    message[n++] = 0x08;
+    unsigned int v = offset;
+    do {
+        message[n] = v & 0x7F;
+        v >>= 7;
+        message[n++] |= v ? 0x80 : 0;
+    } while (v);
+    message[n++] = 0x10;
+    message[n++] = 0x00;
+
+    static const wchar_t alphabet[] = L"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::wstring token;
+    for (size_t i = 0; i < n; i += 3) {
+        unsigned int block = message[i] << 16;
+        if (i + 1 < n) block |= message[i + 1] << 8;
+        if (i + 2 < n) block |= message[i + 2];
+
+        token += alphabet[(block >> 18) & 0x3F];
+        token += alphabet[(block >> 12) & 0x3F];
+        if (i + 1 < n) token += alphabet[(block >> 6) & 0x3F];
+        if (i + 2 < n) token += alphabet[block & 0x3F];
+    }
+    return token; // Without the '=' padding, like the API
+}
+
+void YouTubeAPI::FetchAhead(const std::wstring &baseUrl, const ResponseDecoder::Response &r, IAIMPPlaylist *playlist, std::shared_ptr<LoadingState> state, std::function<void()> finishCallback) {
+    // The page after the one just processed is only taken from the prefetched ones once the real
+    // nextPageToken confirmed its synthesized token, so pages still go in strictly in order
+    const int pageSize = PageSize(baseUrl);
+    const int offset = state->Offset + pageSize;
+    if (pageSize <= 0 || r.NextPageToken != PageToken(offset)) {
+        DebugW(L"YouTubeAPI: unexpected page token at %d, paging one by one\n", offset);
+        DropPrefetched(state);
+        state->PrefetchWindow = 0;
+        LoadFromUrl(baseUrl + L"&pageToken=" + r.NextPageToken, playlist, state, finishCallback);
         return;
+    }
 
-    std::wstring reqUrl(url);
-    if (reqUrl.find(L'?') == std::wstring::npos) {
-        reqUrl += L'?';
+    state->Offset = offset;
+    if (r.TotalResults >= 0)
+        state->TotalResults = r.TotalResults;
+
+    for (int i = 0, o = offset; i <= state->PrefetchWindow; ++i, o += pageSize) {
+        if (o != offset && state->TotalResults >= 0 && o >= state->TotalResults)
+            break;
+        if (state->Prefetched.find(o) == state->Prefetched.end() && state->InFlight.find(o) == state->InFlight.end())
+            Prefetch(baseUrl, o, playlist, state, finishCallback);
+    }
+
+    auto it = state->Prefetched.find(offset);
+    if (it != state->Prefetched.end()) {
+        auto page = it->second;
+        state->Prefetched.erase(it);
+        ProcessPage(baseUrl + L"&pageToken=" + r.NextPageToken, playlist, state, finishCallback, *page);
+    } else if (state->InFlight.find(offset) != state->InFlight.end()) {
+        state->WaitingForPage = true;
     } else {
-        reqUrl += L'&';
+        // Couldn't even send the request, let LoadFromUrl deal with it
+        DropPrefetched(state);
+        LoadFromUrl(baseUrl + L"&pageToken=" + r.NextPageToken, playlist, state, finishCallback);
     }
-    reqUrl += L"key=" TEXT(APP_KEY);
-    if (Plugin::instance()->isConnected())
-        reqUrl += L"\r\nAuthorization: Bearer " + Plugin::instance()->getAccessToken();
+}
 
-    AimpHTTP::Get(reqUrl, [playlist, state, finishCallback, url](unsigned char *data, int size) {
-        rapidjson::Document d;
-        d.Parse(reinterpret_cast<const char *>(data));
+void YouTubeAPI::Prefetch(const std::wstring &baseUrl, int offset, IAIMPPlaylist *playlist, std::shared_ptr<LoadingState> state, std::function<void()> finishCallback) {
+    const std::wstring url(baseUrl + L"&pageToken=" + PageToken(offset));
+    const int generation = state->Generation;
 
-        playlist->BeginUpdate();
-        if (d.IsObject() && d.HasMember("items") && d["items"].IsArray() && d["items"].Size() > 0 && d["items"][0].HasMember("contentDetails") && d["items"][0]["contentDetails"].HasMember("relatedPlaylists")) {
-            const rapidjson::Value &i = d["items"][0]["contentDetails"]["relatedPlaylists"];
-            std::wstring uploads = Tools::ToWString(i["uploads"]);
-            /*std::wstring favorites = Tools::ToWString(i["favorites"]);
-            std::wstring likes = Tools::ToWString(i["likes"]);
-            std::wstring watchLater = Tools::ToWString(i["watchLater"]);*/
-            std::wstring userName = Tools::ToWString(d["items"][0]["snippet"]["localized"]["title"]);
-            IAIMPPropertyList *plProp = nullptr;
-            if (SUCCEEDED(playlist->QueryInterface(IID_IAIMPPropertyList, reinterpret_cast<void **>(&plProp)))) {
-                bool isRenamed = true;
-                IAIMPString *str = nullptr;
-                if (SUCCEEDED(plProp->GetValueAsObject(AIMP_PLAYLIST_PROPID_NAME, IID_IAIMPString, reinterpret_cast<void **>(&str)))) {
-                    isRenamed = wcscmp(L"YouTube", str->GetData());
-                    str->Release();
-                }
-                if (!isRenamed)
-                    plProp->SetValueAsObject(AIMP_PLAYLIST_PROPID_NAME, AIMPString(userName));
-                plProp->Release();
+    state->InFlight.insert(offset);
+    bool started = AimpHTTP::Get(RequestUrl(url, *state), [url, offset, generation, playlist, state, finishCallback](unsigned char *data, int size) {
+        auto r = std::make_shared<ResponseDecoder::Response>();
+        ResponseDecoder::Decode(reinterpret_cast<char *>(data), *r);
+
+        MainThread::Run([url, offset, generation, playlist, state, finishCallback, r, size] {
+            if (state->Generation != generation)
+                return; // The source is done or fell back to serial paging, the playlist may be gone
+
+            state->BytesReceived += size;
+            state->InFlight.erase(offset);
+            if (state->WaitingForPage && offset == state->Offset) {
+                state->WaitingForPage = false;
+                ProcessPage(url, playlist, state, finishCallback, *r);
+            } else {
+                state->Prefetched[offset] = r;
             }
-            state->ReferenceName = userName;
+        });
+    });
+
+    if (!started)
+        state->InFlight.erase(offset);
+}
 
-            LoadFromUrl(L"https://content.googleapis.com/youtube/v3/playlistItems?part=contentDetails%2Csnippet&maxResults=50&playlistId=" + uploads +
-                        L"&fields=items%2Fsnippet%2Ckind%2CnextPageToken%2CpageInfo%2CtokenPagination", playlist, state, finishCallback);
+void YouTubeAPI::DropPrefetched(std::shared_ptr<LoadingState> state) {
+    state->Generation++;
+    state->Prefetched.clear();
+    state->InFlight.clear();
+    state->WaitingForPage = false;
+}
 
-            playlist->EndUpdate();
-            return;
-        } else if (d.IsObject() && d.HasMember("items")) {
-            AddFromJson(playlist, d["items"], state);
+void YouTubeAPI::CollectIds(const ResponseDecoder::Response &r, std::shared_ptr<LoadingState> state) {
+    for (const auto &x : r.Items) {
+        const std::wstring &id = x.VideoId;
+        if (id.empty())
+            continue;
+
+        if (state->TrackIds.find(id) != state->TrackIds.end() || Config::TrackExclusions.find(id) != Config::TrackExclusions.end()) {
+            state->KnownRun++;
         } else {
-            AddFromJson(playlist, d, state);
+            state->KnownRun = 0;
+            state->PendingNew++;
         }
+        state->PageIds.push_back(id);
+    }
+}
+
+void YouTubeAPI::FetchDetails(IAIMPPlaylist *playlist, std::shared_ptr<LoadingState> state, std::function<void()> finishCallback) {
+    // Second phase: snippets and durations, only for what isn't in the playlist yet
+    std::wstring ids;
+    size_t count = 0;
+    for (; state->DetailsOffset < state->PageIds.size() && count < DetailsBatch; state->DetailsOffset++) {
+        const std::wstring &id = state->PageIds[state->DetailsOffset];
+        if (state->TrackIds.find(id) != state->TrackIds.end() || Config::TrackExclusions.find(id) != Config::TrackExclusions.end() ||
+            state->Details.find(id) != state->Details.end())
+            continue;
+
+        state->Details[id]; // Placeholder, dedups repeated IDs until the response fills it in
+        ids += (count++ ? L"," : L"") + id;
+    }
+
+    if (count == 0) {
+        ApplyDetails(playlist, state);
+        NextSource(playlist, state, finishCallback);
+        return;
+    }
+
+    std::wstring reqUrl(L"https://www.googleapis.com/youtube/v3/videos?part=contentDetails%2Csnippet&hl=" + Plugin::instance()->Lang(L"YouTube\\YouTubeLang") +
+                        L"&id=" + ids + L"&fields=items(id%2Csnippet(title%2CchannelTitle%2Cthumbnails%2Fhigh%2Furl)%2CcontentDetails%2Fduration)&key=" TEXT(APP_KEY));
+    if (Plugin::instance()->isConnected())
+        reqUrl += L"\r\nAuthorization: Bearer " + Plugin::instance()->getAccessToken();
+
+    bool started = AimpHTTP::Get(reqUrl, [playlist, state, finishCallback](unsigned char *data, int size) {
+        auto items = std::make_shared<std::vector<VideoItem>>();
+        ResponseDecoder::Response r;
+        bool failed = !ResponseDecoder::Decode(reinterpret_cast<char *>(data), r) || r.Error;
+        ParseItems(r, *items);
+
+        MainThread::Run([playlist, state, finishCallback, items, failed, size] {
+            state->BytesReceived += size;
+            if (failed)
+                state->Failed = true;
+
+            for (auto &x : *items)
+                state->Details[x.Id] = std::move(x);
+
+            FetchDetails(playlist, state, finishCallback);
+        });
+    });
+
+    if (!started) {
+        state->Failed = true;
+        state->DetailsOffset = state->PageIds.size();
+        FetchDetails(playlist, state, finishCallback);
+    }
+}
+
+void YouTubeAPI::ApplyDetails(IAIMPPlaylist *playlist, std::shared_ptr<LoadingState> state) {
+    // Known IDs go in as bare IDs so AddItems keeps the insert position in step with the source
+    std::vector<VideoItem> items;
+    items.reserve(state->PageIds.size());
+    for (const auto &id : state->PageIds) {
+        auto it = state->Details.find(id);
+        if (it == state->Details.end()) {
+            if (state->TrackIds.find(id) == state->TrackIds.end() && Config::TrackExclusions.find(id) == Config::TrackExclusions.end())
+                continue; // Never fetched, the request failed
+
+            VideoItem known;
+            known.Id = id;
+            items.push_back(known);
+        } else if (!it->second.Id.empty()) {
+            items.push_back(it->second);
+        } // else: deleted, private or blocked
+    }
+
+    {
+        PlaylistIndex::Mutation mutation(playlist);
+        playlist->BeginUpdate();
+        AddItems(playlist, items, state);
         playlist->EndUpdate();
+    }
 
-        bool processNextPage = d.IsObject() && d.HasMember("nextPageToken");
+    state->PageIds.clear();
+    state->Details.clear();
+    state->DetailsOffset = 0;
+    state->PendingNew = 0;
+}
 
-        if ((state->Flags & LoadingState::IgnoreNextPage) ||
-            (Config::GetInt32(L"LimitUserStream", 0) && state->AddedItems >= Config::GetInt32(L"LimitUserStreamValue", 5000))) {
-            processNextPage = false;
-        }
+void YouTubeAPI::NextSource(IAIMPPlaylist *playlist, std::shared_ptr<LoadingState> state, std::function<void()> finishCallback) {
+    // Pages prefetched past the end (or past a delta-sync stop) are of no use
+    DropPrefetched(state);
+    state->Offset = 0;
+    state->TotalResults = -1;
 
-        if (processNextPage) {
-            std::wstring next_url(url);
-            std::size_t pos = 0;
-            if ((pos = next_url.find(L"&pageToken")) != std::wstring::npos)
-                next_url = next_url.substr(0, pos);
-
-            LoadFromUrl(next_url + L"&pageToken=" + Tools::ToWString(d["nextPageToken"]), playlist, state, finishCallback);
-        } else if (!state->PendingUrls.empty()) {
-            const LoadingState::PendingUrl &pl = state->PendingUrls.front();
-            if (!pl.Title.empty()) {
-                state->ReferenceName = pl.Title;
-            }
-            if (pl.PlaylistPosition > -3) { // -3 = don't change
-                state->InsertPos = pl.PlaylistPosition;
-                state->Flags = LoadingState::UpdateAdditionalPos | LoadingState::IgnoreExistingPosition;
-            }
+    if (!state->PendingUrls.empty()) {
+        const LoadingState::PendingUrl &pl = state->PendingUrls.front();
+        if (!pl.Title.empty()) {
+            state->ReferenceName = pl.Title;
+        }
+        if (pl.PlaylistPosition > -3) { // -3 = don't change
+            state->InsertPos = pl.PlaylistPosition;
+            state->Flags = LoadingState::UpdateAdditionalPos | LoadingState::IgnoreExistingPosition;
+        }
 
-            LoadFromUrl(pl.Url, playlist, state, finishCallback);
-            state->PendingUrls.pop();
-        } else {
-            // Finished
-            Config::SaveExtendedConfig();
+        state->KnownRun = 0;
+        LoadFromUrl(pl.Url, playlist, state, finishCallback);
+        state->PendingUrls.pop();
+    } else {
+        // Finished
+        DebugW(L"YouTubeAPI: %d items added, %lld bytes received\n", state->AddedItems, state->BytesReceived);
+        Config::SaveExtendedConfig();
 
-            DurationResolver::AddPlaylist(playlist);
+        if (!state->Unresolved.empty()) {
+            DurationResolver::Enqueue(Plugin::instance()->PlaylistId(playlist), state->Unresolved);
             DurationResolver::Resolve();
-
-            playlist->Release();
-            if (finishCallback)
-                finishCallback();
         }
-    });
+
+        playlist->Release();
+        if (finishCallback)
+            finishCallback();
+    }
 }
 
 void YouTubeAPI::LoadUserPlaylist(Config::Playlist &playlist) {
+    Config::WaitUntilLoaded();
+
     if (!Plugin::instance()->isConnected()) {
         OptionsDialog::Connect([&playlist] { LoadUserPlaylist(playlist); });
         return;
     }
     std::wstring playlistId = playlist.ID;
-    std::wstring uname = Config::GetString(L"UserYTName");
+    std::wstring uname = Config::Current().UserYTName;
     std::wstring playlistName(uname + L" - " + playlist.Title);
     std::wstring groupName(uname + L" - " + playlist.Title);
 
@@ -239,6 +588,7 @@ void YouTubeAPI::LoadUserPlaylist(Config::Playlist &playlist) {
     auto state = std::make_shared<LoadingState>();
     state->PlaylistToUpdate = &playlist;
     state->ReferenceName = groupName;
+    state->IdsFirst = true;
     GetExistingTrackIds(pl, state);
 
     std::wstring url(L"https://content.googleapis.com/youtube/v3/playlistItems?part=contentDetails%2Csnippet&maxResults=50&playlistId=" + playlistId +
@@ -255,11 +605,13 @@ void YouTubeAPI::LoadUserPlaylist(Config::Playlist &playlist) {
         plProp->Release();
     }
     playlist.AIMPPlaylistId = plId;
+    Config::MarkPlaylistDirty(playlist.ID);
 
-    if (Config::GetInt32(L"MonitorUserPlaylists", 1)) {
+    if (Config::Current().MonitorUserPlaylists) {
         auto find = [&](const Config::MonitorUrl &p) -> bool { return p.PlaylistID == plId && p.URL == url; };
         if (std::find_if(Config::MonitorUrls.begin(), Config::MonitorUrls.end(), find) == Config::MonitorUrls.end()) {
             Config::MonitorUrls.push_back({ url, plId, state->Flags, groupName });
+            Config::MarkDirty(Config::ShardMonitors);
         }
         Config::SaveExtendedConfig();
     }
@@ -271,71 +623,85 @@ void YouTubeAPI::GetExistingTrackIds(IAIMPPlaylist *pl, std::shared_ptr<LoadingS
     if (!pl || !state)
         return;
 
+    if (MainThread::IsCurrent()) {
+        PlaylistIndex::Ids(pl, state->TrackIds);
+        return;
+    }
+
     // Fetch current track ids from playlist
-    Plugin::instance()->ForEveryItem(pl, [&](IAIMPPlaylistItem *, IAIMPFileInfo *, const std::wstring &id) -> int {
-        if (!id.empty()) {
-            state->TrackIds.insert(id);
-        }
-        return 0;
-    });
+    PlaylistSnapshot snapshot(pl);
+    for (int i = 0, n = snapshot.Count(); i < n; ++i) {
+        if (snapshot.HasId(i))
+            state->TrackIds.insert(snapshot.IdString(i));
+    }
+}
+
+bool YouTubeAPI::IsNewestFirst(const std::wstring &url) {
+    if (url.find(L"/youtube/v3/channels?") != std::wstring::npos)
+        return true; // Resolved to the uploads playlist
+
+    return url.find(L"playlistItems?") != std::wstring::npos && url.find(L"playlistId=UU") != std::wstring::npos;
+}
+
+YouTubeAPI::UrlKind YouTubeAPI::ClassifyUrl(const std::wstring &url, std::wstring &id) {
+    id.clear();
+    if (url.find(L"youtube.com") == std::wstring::npos && url.find(L"youtu.be") == std::wstring::npos)
+        return UrlNone;
+
+    // Up to the next '/', '?' or '&' after the marker
+    auto extract = [&url, &id](std::wstring::size_type pos, const wchar_t *stop) {
+        id = url.substr(pos);
+        std::wstring::size_type end = id.find_first_of(stop);
+        if (end != std::wstring::npos)
+            id.resize(end);
+    };
+
+    std::wstring::size_type pos;
+    if ((pos = url.find(L"/user/")) != std::wstring::npos) {
+        extract(pos + 6, L"/?&");
+        return id.empty() ? UrlNone : UrlUser;
+    } else if ((pos = url.find(L"/channel/")) != std::wstring::npos) {
+        extract(pos + 9, L"/?&");
+        return id.empty() ? UrlNone : UrlChannel;
+    } else if (url.find(L"list=") != std::wstring::npos) {
+        if ((pos = url.find(L"?list=")) != std::wstring::npos || (pos = url.find(L"&list=")) != std::wstring::npos)
+            extract(pos + 6, L"&");
+        return id.empty() ? UrlNone : UrlPlaylist;
+    } else if (url.find(L"watch?") != std::wstring::npos || url.find(L"youtu.be") != std::wstring::npos) {
+        id = Tools::TrackIdFromUrl(url);
+        return id.empty() ? UrlNone : UrlVideo;
+    }
+    return UrlNone;
+}
+
+std::wstring YouTubeAPI::SourceUrl(UrlKind kind, const std::wstring &id) {
+    switch (kind) {
+        case UrlUser:
+            return L"https://www.googleapis.com/youtube/v3/channels?part=contentDetails%2Csnippet&hl=" + Plugin::instance()->Lang(L"YouTube\\YouTubeLang") + L"&forUsername=" + id + L"&fields=items(contentDetails%2Csnippet)";
+        case UrlChannel:
+            return L"https://www.googleapis.com/youtube/v3/channels?part=contentDetails%2Csnippet&hl=" + Plugin::instance()->Lang(L"YouTube\\YouTubeLang") + L"&id=" + id + L"&fields=items(contentDetails%2Csnippet)";
+        case UrlPlaylist:
+            return L"https://content.googleapis.com/youtube/v3/playlistItems?part=contentDetails%2Csnippet&maxResults=50&playlistId=" + id +
+                   L"&fields=items%2Fsnippet%2Ckind%2CnextPageToken%2CpageInfo%2CtokenPagination";
+        case UrlVideo:
+            return L"https://www.googleapis.com/youtube/v3/videos?part=contentDetails%2Csnippet&hl=" + Plugin::instance()->Lang(L"YouTube\\YouTubeLang") + L"&id=" + id;
+        default:
+            return std::wstring();
+    }
 }
 
 void YouTubeAPI::ResolveUrl(const std::wstring &url, const std::wstring &playlistTitle, bool createPlaylist) {
-    if (url.find(L"youtube.com") != std::wstring::npos || url.find(L"youtu.be") != std::wstring::npos) {
-        std::wstring finalUrl;
-        rapidjson::Value *addDirectly = nullptr;
-        std::wstring plName;
+    Config::WaitUntilLoaded();
+
+    std::wstring id;
+    const UrlKind kind = ClassifyUrl(url, id);
+    if (kind != UrlNone) {
+        std::wstring finalUrl = SourceUrl(kind, id);
+        std::wstring plName = L"YouTube";
         bool monitor = true;
         auto state = std::make_shared<LoadingState>();
         std::set<std::wstring> toMonitor;
-        std::wstring ytPlaylistId;
-
-        if (url.find(L"/user/") != std::wstring::npos) {
-            std::wstring id;
-            std::wstring::size_type pos;
-            if ((pos = url.find(L"/user/")) != std::wstring::npos) {
-                id = url.c_str() + pos + 6;
-            }
-            if ((pos = id.find(L'/')) != std::wstring::npos)
-                id.resize(pos);
-
-            finalUrl = L"https://www.googleapis.com/youtube/v3/channels?part=contentDetails%2Csnippet&hl=" + Plugin::instance()->Lang(L"YouTube\\YouTubeLang") + L"&forUsername=" + id + L"&fields=items(contentDetails%2Csnippet)";
-            plName = L"YouTube";
-        } else if (url.find(L"/channel/") != std::wstring::npos) {
-            std::wstring id;
-            std::wstring::size_type pos;
-            if ((pos = url.find(L"/channel/")) != std::wstring::npos) {
-                id = url.c_str() + pos + 9;
-            }
-            if ((pos = id.find(L'/')) != std::wstring::npos)
-                id.resize(pos);
-
-            finalUrl = L"https://www.googleapis.com/youtube/v3/channels?part=contentDetails%2Csnippet&hl=" + Plugin::instance()->Lang(L"YouTube\\YouTubeLang") + L"&id=" + id + L"&fields=items(contentDetails%2Csnippet)";
-            plName = L"YouTube";
-        } else if (url.find(L"list=") != std::wstring::npos) {
-            std::wstring id;
-            std::wstring::size_type pos;
-            if ((pos = url.find(L"?list=")) != std::wstring::npos) {
-                id = url.c_str() + pos + 6;
-            } else if ((pos = url.find(L"&list=")) != std::wstring::npos) {
-                id = url.c_str() + pos + 6;
-            }
-            if ((pos = id.find(L'&')) != std::wstring::npos)
-                id.resize(pos);
-
-            finalUrl = L"https://content.googleapis.com/youtube/v3/playlistItems?part=contentDetails%2Csnippet&maxResults=50&playlistId=" + id +
-                       L"&fields=items%2Fsnippet%2Ckind%2CnextPageToken%2CpageInfo%2CtokenPagination";
-            plName = L"YouTube";
-            ytPlaylistId = id;
-        } else if (url.find(L"watch?") != std::wstring::npos) {
-            std::wstring id = Tools::TrackIdFromUrl(url);
-            finalUrl = L"https://www.googleapis.com/youtube/v3/videos?part=contentDetails%2Csnippet&hl=" + Plugin::instance()->Lang(L"YouTube\\YouTubeLang") + L"&id=" + id;
-            plName = L"YouTube";
-        } else if (url.find(L"youtu.be") != std::wstring::npos) {
-            std::wstring id = Tools::TrackIdFromUrl(url);
-            finalUrl = L"https://www.googleapis.com/youtube/v3/videos?part=contentDetails%2Csnippet&hl=" + Plugin::instance()->Lang(L"YouTube\\YouTubeLang") + L"&id=" + id;
-            plName = L"YouTube";
-        }
+        std::wstring ytPlaylistId = kind == UrlPlaylist ? id : std::wstring();
 
         IAIMPPlaylist *pl = nullptr;
         std::wstring finalPlaylistName;
@@ -368,12 +734,10 @@ void YouTubeAPI::ResolveUrl(const std::wstring &url, const std::wstring &playlis
         }
         if (!ytPlaylistId.empty()) {
             AimpHTTP::Get(L"https://www.googleapis.com/youtube/v3/playlists?part=snippet&hl=" + Plugin::instance()->Lang(L"YouTube\\YouTubeLang") + L"&id=" + ytPlaylistId + L"&key=" TEXT(APP_KEY), [pl](unsigned char *data, int size) {
-                rapidjson::Document d;
-                d.Parse(reinterpret_cast<const char *>(data));
-                if (d.IsObject() && d.HasMember("items") && d["items"].IsArray() && d["items"].Size() > 0 && d["items"][0].HasMember("snippet")) {
-                    rapidjson::Value &val = d["items"][0]["snippet"];
-                    std::wstring channelName = Tools::ToWString(val["channelTitle"]);
-                    std::wstring playlistTitle = Tools::ToWString(val["localized"]["title"]);
+                ResponseDecoder::Response r;
+                if (ResponseDecoder::Decode(reinterpret_cast<char *>(data), r) && !r.Items.empty() && r.Items[0].HasTitle) {
+                    const std::wstring &channelName = r.Items[0].ChannelTitle;
+                    const std::wstring &playlistTitle = r.Items[0].LocalizedTitle;
                     IAIMPPropertyList *plProp = nullptr;
                     if (SUCCEEDED(pl->QueryInterface(IID_IAIMPPropertyList, reinterpret_cast<void **>(&plProp)))) {
                         plProp->SetValueAsObject(AIMP_PLAYLIST_PROPID_NAME, AIMPString(channelName + L" - " + playlistTitle));
@@ -387,11 +751,7 @@ void YouTubeAPI::ResolveUrl(const std::wstring &url, const std::wstring &playlis
 
         GetExistingTrackIds(pl, state);
 
-        if (addDirectly) {
-            AddFromJson(pl, *addDirectly, state);
-        } else {
-            LoadFromUrl(finalUrl, pl, state);
-        }
+        LoadFromUrl(finalUrl, pl, state);
 
         if (monitor) {
             toMonitor.insert(finalUrl);
@@ -399,6 +759,7 @@ void YouTubeAPI::ResolveUrl(const std::wstring &url, const std::wstring &playlis
                 auto find = [&](const Config::MonitorUrl &p) -> bool { return p.PlaylistID == playlistId && p.URL == x; };
                 if (std::find_if(Config::MonitorUrls.begin(), Config::MonitorUrls.end(), find) == Config::MonitorUrls.end()) {
                     Config::MonitorUrls.push_back({ x, playlistId, state->Flags, plName });
+                    Config::MarkDirty(Config::ShardMonitors);
                 }
             }
             Config::SaveExtendedConfig();
@@ -453,7 +814,7 @@ std::wstring getYoutubeDl()
 }
 
 std::wstring YouTubeAPI::GetStreamUrl(const std::wstring &id) {
-	std::wstring youtube_dl = L"\"" + getYoutubeDl() + L"\" -g " + Plugin::instance()->YoutubeDLCmd() + L" -- " + id;
+	std::wstring youtube_dl = L"\"" + getYoutubeDl() + L"\" -g " + Config::Current().YoutubeDLCmd + L" -- " + id;
 
 	HANDLE pipeReadOut = nullptr;
 	HANDLE pipeReadErr = nullptr;
@@ -487,7 +848,7 @@ std::wstring YouTubeAPI::GetStreamUrl(const std::wstring &id) {
 	if (!CreateProcess(nullptr, const_cast<LPWSTR>(youtube_dl.c_str()), nullptr, nullptr, TRUE, CREATE_NO_WINDOW, nullptr, nullptr, &si, &pi))
 		return messageBox(L"CreateProcess");
 
-	DWORD waitResult = WaitForSingleObject(pi.hProcess, Plugin::instance()->YoutubeDLTimeout() * 1000);
+	DWORD waitResult = WaitForSingleObject(pi.hProcess, Config::Current().YoutubeDLTimeout * 1000);
 	if (waitResult == WAIT_TIMEOUT)
 		return std::wstring();
 	if (waitResult != WAIT_OBJECT_0)
@@ -529,65 +890,10 @@ std::wstring YouTubeAPI::GetStreamUrl(const std::wstring &id) {
 }
 
 void YouTubeAPI::AddToPlaylist(Config::Playlist &pl, const std::wstring &trackId) {
-    if (!Plugin::instance()->isConnected()) {
-        OptionsDialog::Connect([&pl, trackId] { AddToPlaylist(pl, trackId); });
-        return;
-    }
-    std::string postData("{"
-        "\"snippet\": {"
-            "\"playlistId\": \"" + Tools::ToString(pl.ID) + "\","
-            "\"resourceId\": {\"videoId\": \""+Tools::ToString(trackId)+"\", \"kind\": \"youtube#video\" }"
-        "}"
-    "}");
-    std::wstring headers(L"\r\nContent-Type: application/json"
-                         L"\r\nAuthorization: Bearer " + Plugin::instance()->getAccessToken());
-
-    AimpHTTP::Post(L"https://www.googleapis.com/youtube/v3/playlistItems?part=snippet" + headers, postData, [&pl, trackId](unsigned char *data, int size) {
-        if (strstr(reinterpret_cast<char *>(data), "youtube#playlistItem")) {
-            pl.Items.insert(trackId);
-            Config::SaveExtendedConfig();
-
-            Timer::SingleShot(0, Plugin::MonitorCallback);
-        }
-    });
+    PlaylistMutations::Enqueue(PlaylistMutations::Add, pl.ID, trackId);
 }
 
 void YouTubeAPI::RemoveFromPlaylist(Config::Playlist &pl, const std::wstring &trackId) {
-    if (!Plugin::instance()->isConnected()) {
-        OptionsDialog::Connect([&pl, trackId] { RemoveFromPlaylist(pl, trackId); });
-        return;
-    }
-    std::wstring headers(L"\r\nAuthorization: Bearer " + Plugin::instance()->getAccessToken());
-
-    AimpHTTP::Get(L"https://content.googleapis.com/youtube/v3/playlistItems?part=id&videoId=" + trackId + L"&playlistId=" + pl.ID +
-                  L"&fields=items%2Fid" + headers, [&pl, trackId, headers](unsigned char *data, int size) {
-        rapidjson::Document d;
-        d.Parse(reinterpret_cast<const char *>(data));
-
-        if (d.IsObject() && d.HasMember("items") && d["items"].IsArray() && d["items"].Size() > 0) {
-            std::wstring url(L"https://www.googleapis.com/youtube/v3/playlistItems?id=" + Tools::ToWString(d["items"][0]["id"]));
-
-            url += L"\r\nX-HTTP-Method-Override: DELETE";
-            url += headers;
-
-            AimpHTTP::Post(url, std::string(), [&pl, trackId](unsigned char *data, int size) {
-                if (strlen(reinterpret_cast<char *>(data)) == 0) {
-                    // removed correctly
-                    pl.Items.erase(trackId);
-                    Config::SaveExtendedConfig();
-
-                    if (IAIMPPlaylist *playlist = Plugin::instance()->GetPlaylistById(pl.AIMPPlaylistId)) {
-                        Plugin::instance()->ForEveryItem(playlist, [&trackId](IAIMPPlaylistItem *, IAIMPFileInfo *, const std::wstring &id) {
-                            if (!id.empty() && id == trackId) {
-                                return Plugin::FLAG_DELETE_ITEM | Plugin::FLAG_STOP_LOOP;
-                            }
-                            return 0;
-                        });
-                        playlist->Release();
-                    }
-                }
-            });
-        }
-    });
+    PlaylistMutations::Enqueue(PlaylistMutations::Remove, pl.ID, trackId);
 }
 
@@ -3,18 +3,36 @@
 #include "rapidjson/document.h"
 #include <queue>
 #include <unordered_set>
+#include <unordered_map>
+#include <vector>
+#include <map>
+#include <set>
 #include <cstdint>
 #include <functional>
 #include <windows.h>
 #include "Config.h"
+#include "ResponseDecoder.h"
 #include <memory>
 
 class IAIMPPlaylist;
 class IAIMPPlaylistItem;
 
 class YouTubeAPI {
+    friend class PushSubscriber;
+    friend class PlaylistMutations;
+    friend class BulkImport;
     typedef std::vector<std::pair<std::function<void(std::string &s, int param)>, int>> DecoderMap;
 public:
+    struct VideoItem {
+        std::wstring Id;
+        std::wstring Title;
+        std::wstring ChannelTitle;
+        std::wstring Artwork;
+        int64_t Duration;
+
+        VideoItem() : Duration(0) {}
+    };
+
     struct LoadingState {
         struct PendingUrl {
             std::wstring Title;
@@ -37,22 +55,65 @@ public:
         int Offset;
         int AddedItems;
         int Flags;
-        LoadingState() : AdditionalPos(0), InsertPos(0), Offset(0), AddedItems(0), PlaylistToUpdate(nullptr), Flags(None) {}
+        bool StopWhenKnown; // Delta sync: stop paging after KnownRunLimit already known items in a row
+        int KnownRun;
+        bool Failed;        // A response was missing or an API error
+        bool IdsFirst;      // Two-phase sync: page through video IDs only, then fetch details of the new ones
+        std::vector<std::wstring> PageIds; // IdsFirst: IDs of the current source, in playlist order
+        int PendingNew;     // IdsFirst: new IDs in PageIds
+        size_t DetailsOffset;
+        std::unordered_map<std::wstring, VideoItem> Details;
+        int64_t BytesReceived;
+        int PrefetchWindow; // playlistItems pages requested ahead with synthesized tokens, 0 = one page at a time
+        int TotalResults;
+        int Generation;     // Bumped when prefetched pages go stale
+        bool WaitingForPage;
+        std::map<int, std::shared_ptr<ResponseDecoder::Response>> Prefetched; // By item offset
+        std::set<int> InFlight;
+        std::vector<std::wstring> Unresolved; // Inserted without a duration, for DurationResolver
+
+        static const int KnownRunLimit = 50; // One full page
+        static const int DefaultPrefetchWindow = 4;
+
+        LoadingState() : AdditionalPos(0), InsertPos(0), Offset(0), AddedItems(0), PlaylistToUpdate(nullptr), Flags(None), StopWhenKnown(false), KnownRun(0), Failed(false),
+                         IdsFirst(false), PendingNew(0), DetailsOffset(0), BytesReceived(0), PrefetchWindow(DefaultPrefetchWindow), TotalResults(-1), Generation(0), WaitingForPage(false) {}
     };
 
     static std::wstring GetStreamUrl(const std::wstring &id);
 
     static void LoadUserPlaylist(Config::Playlist &);
+    // Queued, see PlaylistMutations
     static void AddToPlaylist(Config::Playlist &, const std::wstring &trackId);
     static void RemoveFromPlaylist(Config::Playlist &, const std::wstring &trackId);
 
     static void LoadFromUrl(std::wstring url, IAIMPPlaylist *playlist, std::shared_ptr<LoadingState> state, std::function<void()> finishCallback = std::function<void()>());
     static void ResolveUrl(const std::wstring &url, const std::wstring &playlistTitle = std::wstring(), bool createPlaylist = true);
 
+    enum UrlKind {
+        UrlNone,
+        UrlUser,
+        UrlChannel,
+        UrlPlaylist,
+        UrlVideo
+    };
+    static UrlKind ClassifyUrl(const std::wstring &url, std::wstring &id); // id: user name, channel, playlist or video ID
+    static std::wstring SourceUrl(UrlKind kind, const std::wstring &id); // The API request that lists it
+
     static void GetExistingTrackIds(IAIMPPlaylist *pl, std::shared_ptr<LoadingState> state);
+    static bool IsNewestFirst(const std::wstring &url); // Channel uploads, where anything new shows up on the first pages
+    static std::wstring PageToken(int offset);          // The token the API hands out for the page starting at offset
 
 private:
-    static void AddFromJson(IAIMPPlaylist *, const rapidjson::Value &, std::shared_ptr<LoadingState> state);
+    static void ParseItems(const ResponseDecoder::Response &, std::vector<VideoItem> &items);
+    static void AddItems(IAIMPPlaylist *, const std::vector<VideoItem> &items, std::shared_ptr<LoadingState> state);
+    static void ProcessPage(const std::wstring &url, IAIMPPlaylist *playlist, std::shared_ptr<LoadingState> state, std::function<void()> finishCallback, const ResponseDecoder::Response &r);
+    static void CollectIds(const ResponseDecoder::Response &r, std::shared_ptr<LoadingState> state);
+    static void FetchDetails(IAIMPPlaylist *playlist, std::shared_ptr<LoadingState> state, std::function<void()> finishCallback);
+    static void ApplyDetails(IAIMPPlaylist *playlist, std::shared_ptr<LoadingState> state);
+    static void FetchAhead(const std::wstring &baseUrl, const ResponseDecoder::Response &r, IAIMPPlaylist *playlist, std::shared_ptr<LoadingState> state, std::function<void()> finishCallback);
+    static void Prefetch(const std::wstring &baseUrl, int offset, IAIMPPlaylist *playlist, std::shared_ptr<LoadingState> state, std::function<void()> finishCallback);
+    static void DropPrefetched(std::shared_ptr<LoadingState> state);
+    static void NextSource(IAIMPPlaylist *playlist, std::shared_ptr<LoadingState> state, std::function<void()> finishCallback);
 
     YouTubeAPI();
     YouTubeAPI(const YouTubeAPI &);
@@ -19,6 +19,7 @@
 #define IDC_PLAYLISTTITLECAPTION                1010
 #define IDC_CREATENEW                           1011
 #define IDC_LISTVIEW                            1012
+#define IDC_IMPORTFILE                          1013
 #define IDC_MAINFRAME                           40000
 #define IDC_AUTHGROUPBOX                        40001
 #define IDC_USERINFO                            40002
@@ -36,3 +37,5 @@
 #define IDC_YOUTUBEDLTIMESTR                    40022
 #define IDC_YOUTUBEDLTIMEOUT                    40023
 #define IDC_YOUTUBEDL_UPDATE					40024
+#define IDC_CONCURRENTSYNCSSTR                  40025
+#define IDC_CONCURRENTSYNCS                     40026